@@ -0,0 +1,425 @@
+/* epoll benchmarks.
+
+   These benchmarks measure readiness notification with epoll as a function
+   of the number of registered descriptors, which are a mix of eventfds, pipes
+   and AF_UNIX sockets that never become ready:
+
+     - bench-epoll-wait-*: the wakeup delay of a thread that sleeps in
+       epoll_wait() when an eventfd becomes ready, in level-triggered mode,
+       where the woken thread reads the eventfd to clear its readiness before
+       it takes the end timestamp, and in edge-triggered mode (-et-), where
+       it does not have to. The ping-pong is the one of bench-eventfd.cpp.
+     - bench-epoll-ctl-*: the cost of epoll_ctl() EPOLL_CTL_ADD,
+       EPOLL_CTL_MOD and EPOLL_CTL_DEL on an epoll instance of that size.
+       Interfering threads do the same on an epoll instance of their own
+       that watches the same descriptors.
+     - bench-epoll-wake-*: the wakeup delay of an eventfd that the epoll
+       instances of all interfering threads watch, with and without
+       EPOLLEXCLUSIVE. Without it, every thread wakes up and all but one of
+       them find the eventfd already read (thundering herd).
+
+   The size suffix is the number of registered descriptors. Large sizes need a
+   descriptor limit (RLIMIT_NOFILE) that is large enough, and are skipped
+   otherwise.  */
+
+#include "benchmark.h"
+#include "notifier.hh"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <memory>
+#include <vector>
+
+namespace {
+
+static constexpr size_t K = 1000;
+
+/// Timeout of epoll_wait() in interfering threads (in ms).
+static constexpr int wait_timeout_ms = notifier::wait_timeout_ms;
+
+/// Raise the soft descriptor limit to fit @nr_fds more descriptors. Return
+/// false if the hard limit is too low.
+static bool reserve_fds(size_t nr_fds) {
+  struct rlimit rlim;
+  if (::getrlimit(RLIMIT_NOFILE, &rlim) < 0) {
+    assert(0);
+  }
+  rlim_t needed = nr_fds + 1024;
+  if (rlim.rlim_cur >= needed) {
+    return true;
+  }
+  if (rlim.rlim_max != RLIM_INFINITY && rlim.rlim_max < needed) {
+    return false;
+  }
+  rlim.rlim_cur = needed;
+  return ::setrlimit(RLIMIT_NOFILE, &rlim) == 0;
+}
+
+/* Descriptors that are registered with epoll but never become ready: every
+   third one is an eventfd, the read end of a pipe or an AF_UNIX socket.  */
+class IdleFds {
+  std::vector<int> _registered;
+  std::vector<int> _all;
+  bool _ok = false;
+
+ public:
+  explicit IdleFds(size_t nr_fds) {
+    /* Pipes and sockets take two descriptors, of which one is registered.  */
+    if (!reserve_fds(nr_fds * 5 / 3 + 64 * 3)) {
+      return;
+    }
+    for (size_t i = 0; i < nr_fds; i++) {
+      int fds[2];
+      switch (i % 3) {
+        case 0:
+          fds[0] = ::eventfd(0, EFD_NONBLOCK);
+          if (fds[0] < 0) {
+            assert(0);
+          }
+          _all.push_back(fds[0]);
+          break;
+        case 1:
+          if (::pipe2(fds, O_NONBLOCK) < 0) {
+            assert(0);
+          }
+          _all.insert(_all.end(), {fds[0], fds[1]});
+          break;
+        case 2:
+          if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) < 0) {
+            assert(0);
+          }
+          _all.insert(_all.end(), {fds[0], fds[1]});
+          break;
+      }
+      _registered.push_back(fds[0]);
+    }
+    _ok = true;
+  }
+
+  ~IdleFds() {
+    for (int fd : _all) {
+      ::close(fd);
+    }
+  }
+
+  bool ok() const { return _ok; }
+
+  const std::vector<int>& registered() const { return _registered; }
+
+  /// Create an epoll instance that watches all the descriptors.
+  int create_epoll() const {
+    int epfd = ::epoll_create1(0);
+    if (epfd < 0) {
+      assert(0);
+    }
+    for (int fd : _registered) {
+      struct epoll_event ev = {};
+      ev.events = EPOLLIN;
+      ev.data.fd = fd;
+      if (::epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        assert(0);
+      }
+    }
+    return epfd;
+  }
+};
+
+/* Notifier of benchmark::PingPongAction that wakes up a thread sleeping in
+   epoll_wait() on an epoll instance that watches NR_FDS descriptors, one of
+   which is the eventfd that the measuring thread writes to.  */
+template <size_t NR_FDS, bool EDGE>
+class EpollNotifier {
+  IdleFds _idle{NR_FDS - 1};
+  std::vector<int> _epfds;
+  std::vector<int> _triggers;
+  notifier::Eventfd<false> _reply;
+
+ public:
+  explicit EpollNotifier(size_t nr_remote_threads) : _reply{nr_remote_threads} {
+    if (!_idle.ok()) {
+      return;
+    }
+    for (size_t i = 0; i < nr_remote_threads; i++) {
+      int epfd = _idle.create_epoll();
+      int trigger = ::eventfd(0, EFD_NONBLOCK);
+      if (trigger < 0) {
+        assert(0);
+      }
+      struct epoll_event ev = {};
+      ev.events = EPOLLIN | (EDGE ? uint32_t(EPOLLET) : 0);
+      ev.data.fd = trigger;
+      if (::epoll_ctl(epfd, EPOLL_CTL_ADD, trigger, &ev) < 0) {
+        assert(0);
+      }
+      _epfds.push_back(epfd);
+      _triggers.push_back(trigger);
+    }
+  }
+
+  ~EpollNotifier() {
+    for (size_t i = 0; i < _epfds.size(); i++) {
+      ::close(_epfds[i]);
+      ::close(_triggers[i]);
+    }
+  }
+
+  bool supported() { return _idle.ok(); }
+
+  void notify_remote(const benchmark::ThreadVector& ts, size_t tid) {
+    if (::eventfd_write(_triggers[tid], 1) < 0) {
+      assert(0);
+    }
+  }
+
+  bool wait_remote(size_t tid) {
+    struct epoll_event ev;
+    int nr = ::epoll_wait(_epfds[tid], &ev, 1, wait_timeout_ms);
+    if (nr < 0) {
+      if (errno == EINTR) {
+        return false;
+      }
+      assert(0);
+    }
+    if (nr == 0) {
+      return false;
+    }
+    /* An edge-triggered eventfd reports every write as a new edge, so it
+       does not have to be read.  */
+    if (!EDGE) {
+      eventfd_t value;
+      if (::eventfd_read(_triggers[tid], &value) < 0) {
+        assert(0);
+      }
+    }
+    return true;
+  }
+
+  void notify_local(size_t tid) { _reply.notify_local(tid); }
+
+  void wait_local(size_t tid) { _reply.wait_local(tid); }
+};
+
+template <size_t NR_FDS, bool EDGE>
+using WaitAction = benchmark::PingPongAction<EpollNotifier<NR_FDS, EDGE>>;
+
+enum class Ctl {
+  ADD,
+  MOD,
+  DEL,
+};
+
+struct CtlState {
+  const benchmark::ThreadVector& interfering_threads;
+  const std::vector<int>& fds;
+  int epfd;
+  /// Index of the descriptor of the next operation.
+  size_t idx = 0;
+
+  CtlState(const benchmark::ThreadVector& interfering_threads, const IdleFds& idle)
+      : interfering_threads{interfering_threads}, fds{idle.registered()}, epfd{idle.create_epoll()} {}
+
+  ~CtlState() {
+    ::close(epfd);
+  }
+
+  void ctl(int op, int fd) {
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (::epoll_ctl(epfd, op, fd, &ev) < 0) {
+      assert(0);
+    }
+  }
+};
+
+/* Measure one epoll_ctl() operation on an epoll instance that watches NR_FDS
+   descriptors. Descriptors are added back after EPOLL_CTL_DEL and removed
+   before EPOLL_CTL_ADD, outside of the measurement, so the size of the
+   instance stays the same.  */
+template <Ctl CTL, size_t NR_FDS>
+struct CtlAction {
+  IdleFds idle{NR_FDS};
+
+  CtlState make_state(const benchmark::ThreadVector& ts) { return CtlState(ts, idle); }
+
+  void raw_operation(CtlState& state) {
+    int fd = next_fd(state);
+    prepare(state, fd);
+    operation(state, fd);
+    finish(state, fd);
+  }
+
+  uint64_t measured_operation(CtlState& state) {
+    int fd = next_fd(state);
+    prepare(state, fd);
+    uint64_t start = benchmark::clock_start();
+    operation(state, fd);
+    uint64_t end = benchmark::clock_stop();
+    finish(state, fd);
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(CtlState& state, size_t tid) {
+    raw_operation(state);
+  }
+
+  static int next_fd(CtlState& state) {
+    int fd = state.fds[state.idx];
+    state.idx = (state.idx + 1) % state.fds.size();
+    return fd;
+  }
+
+  static void prepare(CtlState& state, int fd) {
+    if (CTL == Ctl::ADD) {
+      state.ctl(EPOLL_CTL_DEL, fd);
+    }
+  }
+
+  static void operation(CtlState& state, int fd) {
+    switch (CTL) {
+      case Ctl::ADD:
+        state.ctl(EPOLL_CTL_ADD, fd);
+        break;
+      case Ctl::MOD:
+        state.ctl(EPOLL_CTL_MOD, fd);
+        break;
+      case Ctl::DEL:
+        state.ctl(EPOLL_CTL_DEL, fd);
+        break;
+    }
+  }
+
+  static void finish(CtlState& state, int fd) {
+    if (CTL == Ctl::DEL) {
+      state.ctl(EPOLL_CTL_ADD, fd);
+    }
+  }
+
+  bool supported() { return idle.ok(); }
+
+  bool supports_non_interference() { return true; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+static size_t nr_remote_threads;
+
+/* Measure the wakeup delay of an eventfd that the epoll instances of all
+   interfering threads watch. The thread that reads the eventfd takes the end
+   timestamp after the read, because a thread that woke up for an earlier
+   wakeup may read it late, and replies.  */
+template <bool EXCLUSIVE>
+struct WakeAction {
+  int trigger;
+  std::vector<int> epfds;
+  notifier::Eventfd<false> reply{1};
+  uint64_t timestamp = 0;
+
+  WakeAction() {
+    trigger = ::eventfd(0, EFD_NONBLOCK);
+    if (trigger < 0) {
+      assert(0);
+    }
+    for (size_t i = 0; i < nr_remote_threads; i++) {
+      int epfd = ::epoll_create1(0);
+      if (epfd < 0) {
+        assert(0);
+      }
+      struct epoll_event ev = {};
+      ev.events = EPOLLIN | (EXCLUSIVE ? uint32_t(EPOLLEXCLUSIVE) : 0);
+      ev.data.fd = trigger;
+      if (::epoll_ctl(epfd, EPOLL_CTL_ADD, trigger, &ev) < 0) {
+        assert(0);
+      }
+      epfds.push_back(epfd);
+    }
+  }
+
+  ~WakeAction() {
+    for (int epfd : epfds) {
+      ::close(epfd);
+    }
+    ::close(trigger);
+  }
+
+  benchmark::NoState make_state(const benchmark::ThreadVector& ts) { return benchmark::NoState(ts); }
+
+  uint64_t wake() {
+    if (::eventfd_write(trigger, 1) < 0) {
+      assert(0);
+    }
+    reply.wait_local(0);
+    return timestamp;
+  }
+
+  void raw_operation(benchmark::NoState& state) {
+    wake();
+  }
+
+  uint64_t measured_operation(benchmark::NoState& state) {
+    uint64_t start = benchmark::clock_start();
+    uint64_t end = wake();
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(benchmark::NoState& state, size_t tid) {
+    struct epoll_event ev;
+    int nr = ::epoll_wait(epfds[tid], &ev, 1, wait_timeout_ms);
+    if (nr < 0) {
+      if (errno == EINTR) {
+        return;
+      }
+      assert(0);
+    }
+    if (nr == 0) {
+      return;
+    }
+    eventfd_t value;
+    if (::eventfd_read(trigger, &value) < 0) {
+      if (errno == EAGAIN) {
+        /* Another thread read the eventfd first.  */
+        return;
+      }
+      assert(0);
+    }
+    timestamp = benchmark::clock_stop();
+    reply.notify_local(0);
+  }
+
+  bool supports_non_interference() { return false; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+static void init(size_t nr_threads) {
+  nr_remote_threads = nr_threads;
+}
+
+}  // namespace
+
+REGISTER_BENCHMARK((WaitAction<1, false>), "bench-epoll-wait-1", WaitAction<1, false>::init);
+REGISTER_BENCHMARK((WaitAction<1 * K, false>), "bench-epoll-wait-1k", WaitAction<1 * K, false>::init);
+REGISTER_BENCHMARK((WaitAction<10 * K, false>), "bench-epoll-wait-10k", WaitAction<10 * K, false>::init);
+REGISTER_BENCHMARK((WaitAction<100 * K, false>), "bench-epoll-wait-100k", WaitAction<100 * K, false>::init);
+REGISTER_BENCHMARK((WaitAction<1, true>), "bench-epoll-wait-et-1", WaitAction<1, true>::init);
+REGISTER_BENCHMARK((WaitAction<1 * K, true>), "bench-epoll-wait-et-1k", WaitAction<1 * K, true>::init);
+REGISTER_BENCHMARK((WaitAction<10 * K, true>), "bench-epoll-wait-et-10k", WaitAction<10 * K, true>::init);
+REGISTER_BENCHMARK((WaitAction<100 * K, true>), "bench-epoll-wait-et-100k", WaitAction<100 * K, true>::init);
+REGISTER_BENCHMARK((CtlAction<Ctl::ADD, 1>), "bench-epoll-ctl-add-1");
+REGISTER_BENCHMARK((CtlAction<Ctl::ADD, 1 * K>), "bench-epoll-ctl-add-1k");
+REGISTER_BENCHMARK((CtlAction<Ctl::ADD, 10 * K>), "bench-epoll-ctl-add-10k");
+REGISTER_BENCHMARK((CtlAction<Ctl::ADD, 100 * K>), "bench-epoll-ctl-add-100k");
+REGISTER_BENCHMARK((CtlAction<Ctl::MOD, 1>), "bench-epoll-ctl-mod-1");
+REGISTER_BENCHMARK((CtlAction<Ctl::MOD, 1 * K>), "bench-epoll-ctl-mod-1k");
+REGISTER_BENCHMARK((CtlAction<Ctl::MOD, 10 * K>), "bench-epoll-ctl-mod-10k");
+REGISTER_BENCHMARK((CtlAction<Ctl::MOD, 100 * K>), "bench-epoll-ctl-mod-100k");
+REGISTER_BENCHMARK((CtlAction<Ctl::DEL, 1>), "bench-epoll-ctl-del-1");
+REGISTER_BENCHMARK((CtlAction<Ctl::DEL, 1 * K>), "bench-epoll-ctl-del-1k");
+REGISTER_BENCHMARK((CtlAction<Ctl::DEL, 10 * K>), "bench-epoll-ctl-del-10k");
+REGISTER_BENCHMARK((CtlAction<Ctl::DEL, 100 * K>), "bench-epoll-ctl-del-100k");
+REGISTER_BENCHMARK(WakeAction<false>, "bench-epoll-wake-shared", init);
+REGISTER_BENCHMARK(WakeAction<true>, "bench-epoll-wake-exclusive", init);
@@ -0,0 +1,225 @@
+/* File data path benchmarks.
+
+   These benchmarks measure moving data between memory and a file in the
+   work directory (-w), so that tmpfs and local filesystems can be compared.
+   Every thread operates on its own file, so interfering threads contend for
+   the page cache and the filesystem, but not for the same file. Operations
+   walk through the file in order and wrap around at the end.
+
+   The sync benchmarks measure a small write followed by a flush to stable
+   storage, which is the commit latency of a write-ahead log.  */
+
+#include "benchmark.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+static constexpr size_t KB = 1024;
+static constexpr size_t MB = 1024 * KB;
+
+/// Size of the file of every thread.
+static constexpr size_t file_size = 16 * MB;
+
+/// Largest transfer size, which is also the size of the I/O buffer.
+static constexpr size_t max_io_size = 1 * MB;
+
+/// Alignment of the I/O buffer, which satisfies O_DIRECT.
+static constexpr size_t io_alignment = 4 * KB;
+
+struct State {
+  const benchmark::ThreadVector& interfering_threads;
+  std::string path;
+  int fd;
+  char *buf;
+  /// File offset of the next operation.
+  off_t offset = 0;
+
+  /// Create a file of file_size bytes and open it with @flags.
+  State(const benchmark::ThreadVector& interfering_threads, int flags)
+      : interfering_threads{interfering_threads} {
+    buf = static_cast<char *>(::aligned_alloc(io_alignment, max_io_size));
+    if (!buf) {
+      assert(0);
+    }
+    ::memset(buf, 0xaa, max_io_size);
+    int init_fd = benchmark::create_work_file("tmp-bench-file-io", path);
+    if (init_fd < 0) {
+      assert(0);
+    }
+    for (size_t off = 0; off < file_size; off += max_io_size) {
+      if (::pwrite(init_fd, buf, max_io_size, off) != ssize_t(max_io_size)) {
+        assert(0);
+      }
+    }
+    if (::close(init_fd) < 0) {
+      assert(0);
+    }
+    fd = ::open(path.c_str(), O_RDWR | flags);
+    if (fd < 0) {
+      assert(0);
+    }
+  }
+
+  ~State() {
+    ::close(fd);
+    ::unlink(path.c_str());
+    ::free(buf);
+  }
+
+  /// Return the offset of the next operation of @size bytes.
+  off_t next_offset(size_t size) {
+    off_t ret = offset;
+    offset = (offset + size) % file_size;
+    return ret;
+  }
+};
+
+/// Return true if the work directory supports O_DIRECT.
+static bool supports_direct_io() {
+  std::string path;
+  int fd = benchmark::create_work_file("tmp-bench-file-io", path, O_DIRECT);
+  if (fd < 0) {
+    return false;
+  }
+  ::close(fd);
+  ::unlink(path.c_str());
+  return true;
+}
+
+enum class Io {
+  PREAD,
+  PWRITE,
+  READV,
+  WRITEV,
+};
+
+/// Number of buffers of a readv() or writev() operation.
+static constexpr int nr_iovecs = 64;
+
+/* Transfer @size bytes with one system call. Vectored operations split the
+   transfer into nr_iovecs buffers.  */
+template <Io IO, size_t SIZE, int FLAGS = 0>
+struct IoAction {
+  static_assert(SIZE <= max_io_size && file_size % SIZE == 0);
+  static_assert(IO == Io::PREAD || IO == Io::PWRITE || SIZE % nr_iovecs == 0);
+
+  State make_state(const benchmark::ThreadVector& ts) { return State(ts, FLAGS); }
+
+  void raw_operation(State& state) {
+    off_t offset = state.next_offset(SIZE);
+    ssize_t ret;
+    switch (IO) {
+      case Io::PREAD:
+        ret = ::pread(state.fd, state.buf, SIZE, offset);
+        break;
+      case Io::PWRITE:
+        ret = ::pwrite(state.fd, state.buf, SIZE, offset);
+        break;
+      case Io::READV:
+      case Io::WRITEV: {
+        struct iovec iov[nr_iovecs];
+        for (int i = 0; i < nr_iovecs; i++) {
+          iov[i].iov_base = state.buf + i * (SIZE / nr_iovecs);
+          iov[i].iov_len = SIZE / nr_iovecs;
+        }
+        ret = IO == Io::READV ? ::preadv(state.fd, iov, nr_iovecs, offset) : ::pwritev(state.fd, iov, nr_iovecs, offset);
+        break;
+      }
+    }
+    if (ret != ssize_t(SIZE)) {
+      assert(0);
+    }
+  }
+
+  uint64_t measured_operation(State& state) {
+    uint64_t start = benchmark::clock_start();
+    raw_operation(state);
+    uint64_t end = benchmark::clock_stop();
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(State& state, size_t tid) {
+    raw_operation(state);
+  }
+
+  size_t bytes_per_operation() { return SIZE; }
+
+  bool supported() { return !(FLAGS & O_DIRECT) || supports_direct_io(); }
+
+  bool supports_non_interference() { return true; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+enum class Sync {
+  FSYNC,
+  FDATASYNC,
+  SYNC_FILE_RANGE,
+};
+
+/// Write @size bytes and flush them to stable storage.
+template <Sync SYNC, size_t SIZE>
+struct SyncAction {
+  State make_state(const benchmark::ThreadVector& ts) { return State(ts, 0); }
+
+  void raw_operation(State& state) {
+    off_t offset = state.next_offset(SIZE);
+    if (::pwrite(state.fd, state.buf, SIZE, offset) != ssize_t(SIZE)) {
+      assert(0);
+    }
+    int ret;
+    switch (SYNC) {
+      case Sync::FSYNC:
+        ret = ::fsync(state.fd);
+        break;
+      case Sync::FDATASYNC:
+        ret = ::fdatasync(state.fd);
+        break;
+      case Sync::SYNC_FILE_RANGE:
+        ret = ::sync_file_range(state.fd, offset, SIZE, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        break;
+    }
+    if (ret < 0) {
+      assert(0);
+    }
+  }
+
+  uint64_t measured_operation(State& state) {
+    uint64_t start = benchmark::clock_start();
+    raw_operation(state);
+    uint64_t end = benchmark::clock_stop();
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(State& state, size_t tid) {
+    raw_operation(state);
+  }
+
+  size_t bytes_per_operation() { return SIZE; }
+
+  bool supports_non_interference() { return true; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+}  // namespace
+
+REGISTER_BENCHMARK((IoAction<Io::PREAD, 4 * KB>), "bench-file-pread-4kb");
+REGISTER_BENCHMARK((IoAction<Io::PREAD, 64 * KB>), "bench-file-pread-64kb");
+REGISTER_BENCHMARK((IoAction<Io::PREAD, 1 * MB>), "bench-file-pread-1mb");
+REGISTER_BENCHMARK((IoAction<Io::PWRITE, 4 * KB>), "bench-file-pwrite-4kb");
+REGISTER_BENCHMARK((IoAction<Io::PWRITE, 64 * KB>), "bench-file-pwrite-64kb");
+REGISTER_BENCHMARK((IoAction<Io::PWRITE, 1 * MB>), "bench-file-pwrite-1mb");
+REGISTER_BENCHMARK((IoAction<Io::READV, 64 * KB>), "bench-file-readv-64kb");
+REGISTER_BENCHMARK((IoAction<Io::WRITEV, 64 * KB>), "bench-file-writev-64kb");
+REGISTER_BENCHMARK((IoAction<Io::PREAD, 4 * KB, O_DIRECT>), "bench-file-pread-direct-4kb");
+REGISTER_BENCHMARK((IoAction<Io::PWRITE, 4 * KB, O_DIRECT>), "bench-file-pwrite-direct-4kb");
+REGISTER_BENCHMARK((IoAction<Io::PREAD, 1 * MB, O_DIRECT>), "bench-file-pread-direct-1mb");
+REGISTER_BENCHMARK((IoAction<Io::PWRITE, 1 * MB, O_DIRECT>), "bench-file-pwrite-direct-1mb");
+REGISTER_BENCHMARK((SyncAction<Sync::FSYNC, 4 * KB>), "bench-file-fsync-4kb");
+REGISTER_BENCHMARK((SyncAction<Sync::FDATASYNC, 4 * KB>), "bench-file-fdatasync-4kb");
+REGISTER_BENCHMARK((SyncAction<Sync::SYNC_FILE_RANGE, 4 * KB>), "bench-file-sync-file-range-4kb");
@@ -0,0 +1,152 @@
+/* Futex wakeup fan-out benchmarks.
+
+   These benchmarks measure waking up threads that all sleep on the same
+   futex word, which is how a condition variable or a barrier is built. The
+   interfering threads sleep on the word and the measuring thread bumps it
+   and wakes them up with one of:
+
+     - FUTEX_WAKE of one thread.
+     - FUTEX_WAKE of all threads.
+     - FUTEX_CMP_REQUEUE that wakes up one thread and moves the rest to a
+       second futex word, which works as a mutex: every woken thread wakes up
+       the next one from the second word, which avoids the thundering herd.
+
+   Every woken thread takes a timestamp, and the measurement ends at the
+   latest timestamp of the threads that are expected to wake up. That is, the
+   measurement is the tail latency of the wakeup fan-out. The number of
+   sleeping threads is set with -n.  */
+
+#include "benchmark.h"
+#include "futex.hh"
+
+#include <climits>
+
+namespace {
+
+/// Longest time an interfering thread sleeps before it checks for the end of
+/// the measurement.
+static constexpr long wait_timeout_ms = 100;
+
+enum class Wake {
+  ONE,
+  ALL,
+  REQUEUE,
+};
+
+struct State {
+  const benchmark::ThreadVector& interfering_threads;
+  /// Generation of the futex word that the thread has seen.
+  uint32_t seen = 0;
+};
+
+static size_t nr_remote_threads;
+
+template <Wake WAKE>
+struct Action {
+  /// Futex word that threads sleep on, which is bumped on every wakeup.
+  alignas(64) futex::Word generation{0};
+  /// Futex word that FUTEX_CMP_REQUEUE moves sleeping threads to.
+  alignas(64) futex::Word handoff{0};
+  /// Number of threads that still have to wake up in the upper 32 bits
+  /// and the generation that they have to see in the lower 32 bits.
+  alignas(64) std::atomic<uint64_t> pending{0};
+  /// Number of woken up threads that have not recorded their timestamp yet.
+  std::atomic<size_t> unfinished{0};
+  /// Latest wakeup timestamp of the current generation.
+  std::atomic<uint64_t> latest{0};
+  /// Futex word that the measuring thread sleeps on until all expected threads
+  /// woke up.
+  alignas(64) futex::Word done{0};
+
+  State make_state(const benchmark::ThreadVector& ts) { return State{ts}; }
+
+  size_t nr_expected() const { return WAKE == Wake::ONE ? 1 : nr_remote_threads; }
+
+  uint64_t wake_and_wait() {
+    uint32_t gen = generation.load() + 1;
+    pending.store(uint64_t(nr_expected()) << 32 | gen);
+    unfinished.store(nr_expected());
+    latest.store(0);
+    done.store(0);
+    generation.store(gen);
+    long ret;
+    switch (WAKE) {
+      case Wake::ONE:
+        ret = futex::wake(&generation, 1);
+        break;
+      case Wake::ALL:
+        ret = futex::wake(&generation, INT_MAX);
+        break;
+      case Wake::REQUEUE:
+        ret = futex::cmp_requeue(&generation, 1, INT_MAX, &handoff, gen);
+        break;
+    }
+    if (ret < 0) {
+      assert(0);
+    }
+    while (done.load() == 0) {
+      if (futex::wait(&done, 0) < 0 && errno != EAGAIN && errno != EINTR) {
+        assert(0);
+      }
+    }
+    return latest.load();
+  }
+
+  void raw_operation(State& state) {
+    wake_and_wait();
+  }
+
+  uint64_t measured_operation(State& state) {
+    uint64_t start = benchmark::clock_start();
+    uint64_t end = wake_and_wait();
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(State& state, size_t tid) {
+    uint32_t gen = generation.load();
+    if (gen == state.seen) {
+      struct timespec timeout = {0, wait_timeout_ms * 1000000};
+      if (futex::wait(&generation, gen, &timeout) < 0 && errno != EAGAIN && errno != ETIMEDOUT && errno != EINTR) {
+        assert(0);
+      }
+      return;
+    }
+    uint64_t now = benchmark::clock_stop();
+    state.seen = gen;
+    /* Only the expected number of threads of this generation count as woken
+       up. With a wakeup of one thread, others may notice the new generation
+       on timeout, or notice an old generation late.  */
+    uint64_t claim = pending.load();
+    do {
+      if (uint32_t(claim) != gen || (claim >> 32) == 0) {
+        return;
+      }
+    } while (!pending.compare_exchange_weak(claim, claim - (uint64_t(1) << 32)));
+    uint64_t prev = latest.load();
+    while (prev < now && !latest.compare_exchange_weak(prev, now)) {
+    }
+    if (WAKE == Wake::REQUEUE && futex::wake(&handoff, 1) < 0) {
+      assert(0);
+    }
+    if (unfinished.fetch_sub(1) == 1) {
+      done.store(1);
+      if (futex::wake(&done, 1) < 0) {
+        assert(0);
+      }
+    }
+  }
+
+  bool supports_non_interference() { return false; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+static void init(size_t nr_threads) {
+  nr_remote_threads = nr_threads;
+}
+
+}  // namespace
+
+REGISTER_BENCHMARK(Action<Wake::ONE>, "bench-futex-wake-one", init);
+REGISTER_BENCHMARK(Action<Wake::ALL>, "bench-futex-wake-all", init);
+REGISTER_BENCHMARK(Action<Wake::REQUEUE>, "bench-futex-cmp-requeue", init);
@@ -0,0 +1,187 @@
+/* Futex wakeup benchmarks.
+
+   These benchmarks measure the time to wake up a thread that sleeps on a
+   futex, without the pthread wrappers on top. The measuring thread wakes up
+   one interfering thread at a time and waits for it to reply. As in
+   bench-eventfd.cpp, the woken thread takes the end timestamp, so the
+   measurement is the wakeup delay and not the full round trip.
+
+   The variants differ in how the interfering threads sleep:
+
+     - FUTEX_WAIT on a futex word of their own.
+     - FUTEX_WAIT_BITSET on a futex word shared by all threads, with one bit
+       per thread, so that FUTEX_WAKE_BITSET wakes up only the target thread.
+     - futex_waitv() on a vector of futex words of their own, where only the
+       last one is used for wakeups (Linux 5.16 and later).
+
+   Sleeping threads time out periodically, so that they notice the end of
+   the measurement.  */
+
+#include "benchmark.h"
+#include "futex.hh"
+
+#include <climits>
+#include <memory>
+
+namespace {
+
+/// Longest time an interfering thread sleeps before it checks for the end of
+/// the measurement.
+static constexpr long wait_timeout_ms = 100;
+
+/// Number of futex words of a futex_waitv() sleep.
+static constexpr unsigned nr_waitv_words = 8;
+
+enum class Wait {
+  WAIT,
+  WAIT_BITSET,
+  WAITV,
+};
+
+struct alignas(64) Slot {
+  /// Nonzero when the thread has been asked to reply.
+  futex::Word word{0};
+  /// Futex words of a futex_waitv() sleep that are never woken up.
+  futex::Word idle[nr_waitv_words - 1] = {};
+  /// Time at which the thread woke up.
+  uint64_t timestamp = 0;
+};
+
+static size_t nr_remote_threads;
+
+template <Wait WAIT>
+struct Action {
+  std::unique_ptr<Slot[]> slots;
+  /// Futex word that all threads sleep on with FUTEX_WAIT_BITSET.
+  alignas(64) futex::Word shared{0};
+  /// Futex word that the measuring thread sleeps on for a reply.
+  alignas(64) futex::Word reply{0};
+  /// The running index of remote thread to wake up.
+  size_t remote_idx = 0;
+
+  Action() : slots{new Slot[nr_remote_threads]} {}
+
+  benchmark::NoState make_state(const benchmark::ThreadVector& ts) { return benchmark::NoState(ts); }
+
+  void wake(size_t idx) {
+    Slot& slot = slots[idx];
+    slot.word.store(1);
+    long ret;
+    switch (WAIT) {
+      case Wait::WAIT:
+      case Wait::WAITV:
+        ret = futex::wake(&slot.word, 1);
+        break;
+      case Wait::WAIT_BITSET:
+        shared.fetch_add(1);
+        ret = futex::wake_bitset(&shared, INT_MAX, bit(idx));
+        break;
+    }
+    if (ret < 0) {
+      assert(0);
+    }
+  }
+
+  /// Wait for the reply of the thread and return its wakeup timestamp.
+  uint64_t wait_reply(size_t idx) {
+    while (reply.load() == 0) {
+      if (futex::wait(&reply, 0) < 0 && errno != EAGAIN && errno != EINTR) {
+        assert(0);
+      }
+    }
+    reply.store(0);
+    return slots[idx].timestamp;
+  }
+
+  void raw_operation(benchmark::NoState& state) {
+    wake(remote_idx);
+    wait_reply(remote_idx);
+    remote_idx = (remote_idx + 1) % nr_remote_threads;
+  }
+
+  uint64_t measured_operation(benchmark::NoState& state) {
+    uint64_t start = benchmark::clock_start();
+    wake(remote_idx);
+    uint64_t end = wait_reply(remote_idx);
+    remote_idx = (remote_idx + 1) % nr_remote_threads;
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(benchmark::NoState& state, size_t tid) {
+    Slot& slot = slots[tid];
+    if (!sleep(slot, tid)) {
+      return;
+    }
+    slot.timestamp = benchmark::clock_stop();
+    slot.word.store(0);
+    reply.store(1);
+    if (futex::wake(&reply, 1) < 0) {
+      assert(0);
+    }
+  }
+
+  /// Sleep until the thread is asked to reply. Return false on timeout or if
+  /// the benchmark harness sent a signal to wake up blocked system calls.
+  bool sleep(Slot& slot, size_t tid) {
+    for (;;) {
+      uint32_t val = shared.load();
+      if (slot.word.load()) {
+        return true;
+      }
+      long ret;
+      switch (WAIT) {
+        case Wait::WAIT: {
+          struct timespec timeout = {0, wait_timeout_ms * 1000000};
+          ret = futex::wait(&slot.word, 0, &timeout);
+          break;
+        }
+        case Wait::WAIT_BITSET: {
+          struct timespec deadline = futex::deadline_after_ms(wait_timeout_ms);
+          ret = futex::wait_bitset(&shared, val, bit(tid), &deadline);
+          break;
+        }
+        case Wait::WAITV: {
+#ifdef __NR_futex_waitv
+          struct futex_waitv waiters[nr_waitv_words] = {};
+          for (unsigned i = 0; i < nr_waitv_words; i++) {
+            futex::Word *word = i == nr_waitv_words - 1 ? &slot.word : &slot.idle[i];
+            waiters[i].uaddr = reinterpret_cast<uintptr_t>(word);
+            waiters[i].flags = FUTEX_32 | FUTEX_PRIVATE_FLAG;
+          }
+          struct timespec deadline = futex::deadline_after_ms(wait_timeout_ms);
+          ret = futex::waitv(waiters, nr_waitv_words, &deadline);
+#else
+          assert(0);
+#endif
+          break;
+        }
+      }
+      if (ret < 0) {
+        if (errno == ETIMEDOUT || errno == EINTR) {
+          return false;
+        }
+        if (errno != EAGAIN) {
+          assert(0);
+        }
+      }
+    }
+  }
+
+  static uint32_t bit(size_t tid) { return 1u << (tid % 32); }
+
+  bool supported() { return WAIT != Wait::WAITV || futex::supports_waitv(); }
+
+  bool supports_non_interference() { return false; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+static void init(size_t nr_threads) {
+  nr_remote_threads = nr_threads;
+}
+
+}  // namespace
+
+REGISTER_BENCHMARK(Action<Wait::WAIT>, "bench-futex-wait", init);
+REGISTER_BENCHMARK(Action<Wait::WAIT_BITSET>, "bench-futex-wait-bitset", init);
+REGISTER_BENCHMARK(Action<Wait::WAITV>, "bench-futex-waitv", init);
@@ -2,12 +2,14 @@
 
 #include <unistd.h>
 
+namespace {
+
 struct Op {
   void operator()(benchmark::NoState& tate) {
     ::getuid();
   }
 };
 
-int main(int argc, char *argv[]) {
-  benchmark::run_all<benchmark::SymmetricAction<Op>>(argc, argv);
-}
+}  // namespace
+
+REGISTER_BENCHMARK(benchmark::SymmetricAction<Op>, "bench-getuid");
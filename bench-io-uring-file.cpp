@@ -0,0 +1,184 @@
+/* io_uring file operation benchmarks.
+
+   These benchmarks measure openat, close and read requests submitted through
+   io_uring, to be compared with the same operations as system calls in
+   bench-open and bench-close. Every request is submitted and waited for with
+   one io_uring_enter() call.  */
+
+#include "benchmark.h"
+#include "io_uring.hh"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+static constexpr size_t read_size = 4096;
+
+static std::string filename;
+
+struct State {
+  const benchmark::ThreadVector& interfering_threads;
+  uring::Ring ring{8};
+  int fd;
+  char buf[read_size];
+
+  State(const benchmark::ThreadVector& interfering_threads)
+      : interfering_threads{interfering_threads} {
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      assert(0);
+    }
+  }
+
+  ~State() {
+    ::close(fd);
+  }
+
+  int submit_and_wait() {
+    ring.submit(1);
+    return ring.wait_cqe();
+  }
+};
+
+/* Create a file with read_size bytes of data that every benchmark operates
+   on.  */
+struct FileAction {
+  FileAction() {
+    int fd = benchmark::create_work_file("tmp-bench-io-uring", filename, O_CREAT);
+    if (fd < 0) {
+      assert(0);
+    }
+    char buf[read_size] = {};
+    if (::write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+      assert(0);
+    }
+    if (::close(fd) < 0) {
+      assert(0);
+    }
+  }
+
+  ~FileAction() {
+    if (::unlink(filename.c_str()) < 0) {
+      assert(0);
+    }
+  }
+
+  State make_state(const benchmark::ThreadVector& ts) { return State(ts); }
+
+  bool supported() { return uring::supported(); }
+
+  bool supports_non_interference() { return true; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+static void prep_openat(struct io_uring_sqe *sqe) {
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = reinterpret_cast<uintptr_t>(filename.c_str());
+  sqe->open_flags = O_RDWR;
+}
+
+static void prep_close(struct io_uring_sqe *sqe, int fd) {
+  sqe->opcode = IORING_OP_CLOSE;
+  sqe->fd = fd;
+}
+
+/// Measure IORING_OP_OPENAT. The file is closed with close().
+struct OpenAction : FileAction {
+  void raw_operation(State& state) {
+    prep_openat(state.ring.get_sqe());
+    int fd = state.submit_and_wait();
+    if (fd < 0) {
+      assert(0);
+    }
+    if (::close(fd) < 0) {
+      assert(0);
+    }
+  }
+
+  uint64_t measured_operation(State& state) {
+    uint64_t start = benchmark::clock_start();
+    prep_openat(state.ring.get_sqe());
+    int fd = state.submit_and_wait();
+    if (fd < 0) {
+      assert(0);
+    }
+    uint64_t end = benchmark::clock_stop();
+    if (::close(fd) < 0) {
+      assert(0);
+    }
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(State& state, size_t tid) {
+    raw_operation(state);
+  }
+};
+
+/// Measure IORING_OP_CLOSE. The file is opened with open().
+struct CloseAction : FileAction {
+  void raw_operation(State& state) {
+    int fd = ::open(filename.c_str(), O_RDWR);
+    if (fd < 0) {
+      assert(0);
+    }
+    prep_close(state.ring.get_sqe(), fd);
+    if (state.submit_and_wait() < 0) {
+      assert(0);
+    }
+  }
+
+  uint64_t measured_operation(State& state) {
+    int fd = ::open(filename.c_str(), O_RDWR);
+    if (fd < 0) {
+      assert(0);
+    }
+    uint64_t start = benchmark::clock_start();
+    prep_close(state.ring.get_sqe(), fd);
+    if (state.submit_and_wait() < 0) {
+      assert(0);
+    }
+    uint64_t end = benchmark::clock_stop();
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(State& state, size_t tid) {
+    raw_operation(state);
+  }
+};
+
+/// Measure an IORING_OP_READ of read_size bytes from the page cache.
+struct ReadAction : FileAction {
+  void raw_operation(State& state) {
+    struct io_uring_sqe *sqe = state.ring.get_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = state.fd;
+    sqe->addr = reinterpret_cast<uintptr_t>(state.buf);
+    sqe->len = sizeof(state.buf);
+    sqe->off = 0;
+    if (state.submit_and_wait() != sizeof(state.buf)) {
+      assert(0);
+    }
+  }
+
+  uint64_t measured_operation(State& state) {
+    uint64_t start = benchmark::clock_start();
+    raw_operation(state);
+    uint64_t end = benchmark::clock_stop();
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(State& state, size_t tid) {
+    raw_operation(state);
+  }
+};
+
+}  // namespace
+
+REGISTER_BENCHMARK(OpenAction, "bench-io-uring-open");
+REGISTER_BENCHMARK(CloseAction, "bench-io-uring-close");
+REGISTER_BENCHMARK(ReadAction, "bench-io-uring-read");
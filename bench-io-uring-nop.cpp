@@ -0,0 +1,50 @@
+/* io_uring NOP benchmark.
+
+   This benchmark measures the round trip of IORING_OP_NOP requests through
+   io_uring_enter(), which is the fixed cost of every io_uring request. A
+   sample submits a batch of NR_SQES requests with one io_uring_enter() call
+   and waits for all of them to complete.  */
+
+#include "benchmark.h"
+#include "io_uring.hh"
+
+namespace {
+
+static constexpr unsigned RING_ENTRIES = 64;
+
+struct State {
+  const benchmark::ThreadVector& interfering_threads;
+  uring::Ring ring{RING_ENTRIES};
+
+  State(const benchmark::ThreadVector& interfering_threads)
+      : interfering_threads{interfering_threads}
+  {}
+};
+
+template <unsigned NR_SQES>
+struct Op {
+  static_assert(NR_SQES <= RING_ENTRIES);
+
+  void operator()(State& state) {
+    for (unsigned i = 0; i < NR_SQES; i++) {
+      state.ring.get_sqe()->opcode = IORING_OP_NOP;
+    }
+    state.ring.submit(NR_SQES);
+    for (unsigned i = 0; i < NR_SQES; i++) {
+      if (state.ring.wait_cqe() < 0) {
+        assert(0);
+      }
+    }
+  }
+};
+
+template <unsigned NR_SQES>
+struct Action : benchmark::SymmetricAction<Op<NR_SQES>, State> {
+  bool supported() { return uring::supported(); }
+};
+
+}  // namespace
+
+REGISTER_BENCHMARK(Action<1>, "bench-io-uring-nop");
+REGISTER_BENCHMARK(Action<8>, "bench-io-uring-nop-8");
+REGISTER_BENCHMARK(Action<64>, "bench-io-uring-nop-64");
@@ -0,0 +1,88 @@
+/* io_uring SQPOLL benchmark.
+
+   This benchmark measures the round trip of an IORING_OP_NOP request through
+   a ring set up with IORING_SETUP_SQPOLL. The measuring thread publishes the
+   request in the submission queue without a system call and busy-polls the
+   completion queue, while the kernel poller thread picks up the request.
+
+   The poller thread is pinned to the PU of the first interfering thread, so
+   the interference scenarios measure the cost of the distance between the
+   submitting thread and the poller (SMT, multicore, NUMA). The interfering
+   threads themselves sleep to leave their PU to the poller.  */
+
+#include "benchmark.h"
+#include "io_uring.hh"
+
+#include <sched.h>
+
+#include <memory>
+
+namespace {
+
+static constexpr unsigned RING_ENTRIES = 64;
+
+/// Idle time after which the poller thread goes to sleep (in ms).
+static constexpr unsigned SQ_THREAD_IDLE_MS = 1000;
+
+struct State {
+  const benchmark::ThreadVector& interfering_threads;
+  /// The ring to submit to, or null on interfering threads.
+  uring::Ring *ring;
+};
+
+struct Action {
+  std::mutex lock;
+  std::condition_variable cond;
+  std::unique_ptr<uring::Ring> ring;
+
+  /* The first interfering thread sets up the ring, because it runs on the PU
+     that the poller thread is pinned to. The measuring thread waits until the
+     ring is set up.  */
+  State make_state(const benchmark::ThreadVector& ts) {
+    auto self = std::this_thread::get_id();
+    std::unique_lock<std::mutex> guard(lock);
+    if (!ts.empty() && ts.front().get_id() == self) {
+      if (!ring) {
+        ring = std::make_unique<uring::Ring>(RING_ENTRIES, IORING_SETUP_SQPOLL, ::sched_getcpu(), SQ_THREAD_IDLE_MS);
+        cond.notify_all();
+      }
+      return State{ts, nullptr};
+    }
+    for (auto& t : ts) {
+      if (t.get_id() == self) {
+        return State{ts, nullptr};
+      }
+    }
+    cond.wait(guard, [this] { return ring != nullptr; });
+    return State{ts, ring.get()};
+  }
+
+  void raw_operation(State& state) {
+    state.ring->get_sqe()->opcode = IORING_OP_NOP;
+    state.ring->submit();
+    if (state.ring->wait_cqe() < 0) {
+      assert(0);
+    }
+  }
+
+  uint64_t measured_operation(State& state) {
+    uint64_t start = benchmark::clock_start();
+    raw_operation(state);
+    uint64_t end = benchmark::clock_stop();
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(State& state, size_t tid) {
+    ::usleep(10000);
+  }
+
+  bool supported() { return uring::supported(IORING_SETUP_SQPOLL, ::sched_getcpu()); }
+
+  bool supports_non_interference() { return false; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+}  // namespace
+
+REGISTER_BENCHMARK(Action, "bench-io-uring-sqpoll");
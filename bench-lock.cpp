@@ -0,0 +1,108 @@
+/* Lock algorithm benchmarks.
+
+   These benchmarks measure acquiring and releasing a lock around a critical
+   section that increments a counter, for lock algorithms that are not in
+   glibc (see bench-pthread-mutex.cpp and others for those):
+
+     - ttas: test-and-test-and-set spinlock with exponential backoff.
+     - ticket: ticket lock.
+     - mcs, clh: MCS and CLH queue locks.
+     - futex: futex-based mutex that sleeps when contended.
+     - cohort: NUMA-aware cohort lock with a ticket lock per package.
+
+   The interfering threads contend for the same lock, so the interference
+   scenarios give the acquire latency with contenders on the same core, on
+   other cores and in other packages. A scaling run (-t) gives the aggregate
+   throughput and the fairness of the lock as the number of contending
+   threads grows.
+
+   The seqlock-read benchmark measures a sequence lock reader that copies
+   SEQLOCK_WORDS words, with the interfering threads updating them.  */
+
+#include "benchmark.h"
+#include "lock.hh"
+
+namespace {
+
+static constexpr size_t SEQLOCK_WORDS = 8;
+
+template <typename Lock>
+struct State {
+  const benchmark::ThreadVector& interfering_threads;
+  typename Lock::Handle handle;
+
+  State(const benchmark::ThreadVector& interfering_threads, typename Lock::Handle handle)
+      : interfering_threads{interfering_threads}, handle{handle} {}
+};
+
+template <typename Lock>
+struct Action {
+  Lock lock;
+  /// Data protected by the lock.
+  alignas(64) uint64_t counter = 0;
+
+  State<Lock> make_state(const benchmark::ThreadVector& ts) { return State<Lock>(ts, lock.make_handle()); }
+
+  void raw_operation(State<Lock>& state) {
+    lock.lock(state.handle);
+    counter++;
+    lock.unlock(state.handle);
+  }
+
+  uint64_t measured_operation(State<Lock>& state) {
+    uint64_t start = benchmark::clock_start();
+    raw_operation(state);
+    uint64_t end = benchmark::clock_stop();
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(State<Lock>& state, size_t tid) { raw_operation(state); }
+
+  bool supports_non_interference() { return true; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+struct SeqLockAction {
+  lock::SeqLock<SEQLOCK_WORDS> seqlock;
+  /// Value of the next update.
+  alignas(64) std::atomic<uint64_t> version{0};
+
+  benchmark::NoState make_state(const benchmark::ThreadVector& ts) { return benchmark::NoState(ts); }
+
+  void raw_operation(benchmark::NoState& state) {
+    uint64_t data[SEQLOCK_WORDS];
+    seqlock.read(data);
+    for (size_t i = 1; i < SEQLOCK_WORDS; i++) {
+      if (data[i] != data[0]) {
+        /* Torn read.  */
+        assert(0);
+      }
+    }
+  }
+
+  uint64_t measured_operation(benchmark::NoState& state) {
+    uint64_t start = benchmark::clock_start();
+    raw_operation(state);
+    uint64_t end = benchmark::clock_stop();
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(benchmark::NoState& state, size_t tid) {
+    seqlock.write(version.fetch_add(1, std::memory_order_relaxed));
+  }
+
+  bool supports_non_interference() { return true; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+}  // namespace
+
+REGISTER_BENCHMARK(Action<lock::Ttas>, "bench-lock-ttas");
+REGISTER_BENCHMARK(Action<lock::Ticket>, "bench-lock-ticket");
+REGISTER_BENCHMARK(Action<lock::Mcs>, "bench-lock-mcs");
+REGISTER_BENCHMARK(Action<lock::Clh>, "bench-lock-clh");
+REGISTER_BENCHMARK(Action<lock::Futex>, "bench-lock-futex");
+REGISTER_BENCHMARK(Action<lock::Cohort>, "bench-lock-cohort");
+REGISTER_BENCHMARK(SeqLockAction, "bench-lock-seqlock-read");
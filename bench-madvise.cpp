@@ -0,0 +1,395 @@
+/* madvise(), transparent huge page and MAP_FIXED_NOREPLACE benchmarks.
+
+   The bench-madvise-* benchmarks measure madvise() on a populated region,
+   which is how memory allocators return memory to the kernel or prepare it:
+
+     - dontneed: MADV_DONTNEED, which frees the pages immediately.
+     - free: MADV_FREE, which frees the pages lazily under memory pressure.
+     - cold: MADV_COLD, which deactivates the pages.
+     - pageout: MADV_PAGEOUT, which reclaims the pages. Anonymous pages are
+       only reclaimed if there is swap.
+     - populate-read, populate-write: MADV_POPULATE_READ and
+       MADV_POPULATE_WRITE, which fault in an empty region.
+     - hugepage: MADV_HUGEPAGE on a region of 4 KB pages.
+
+   The -4kb variants use 4 KB pages (MADV_NOHUGEPAGE) and the -2mb variants
+   transparent huge pages (MADV_HUGEPAGE). The region is 2 MB, or 64 MB with
+   the -64mb suffix. The region is populated again (or emptied for the
+   populate advices) after every operation, outside of the measurement.
+
+   The bench-thp-fault benchmarks measure a write fault on a new 2 MB region
+   backed by a transparent huge page (bench-thp-fault), by hugetlbfs
+   (-hugetlbfs) or by 4 KB pages (-4kb).
+
+   The bench-mmap-fixed-noreplace-* benchmarks measure mapping 2 MB at a
+   free address with MAP_FIXED_NOREPLACE, with 4 KB pages or hugetlbfs.  */
+
+#include "benchmark.h"
+
+#include <linux/mman.h>
+#include <sys/mman.h>
+
+#include <fstream>
+#include <memory>
+#include <vector>
+
+namespace {
+
+static constexpr size_t KB = 1024;
+static constexpr size_t MB = 1024 * KB;
+
+static constexpr size_t small_page_size = 4 * KB;
+static constexpr size_t huge_page_size = 2 * MB;
+
+enum class Page {
+  /// 4 KB pages.
+  SMALL,
+  /// Transparent huge pages.
+  THP,
+  /// hugetlbfs pages.
+  HUGETLB,
+};
+
+/// Return true if transparent huge pages can be enabled with madvise().
+static bool thp_enabled() {
+  std::ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+  std::string line;
+  std::getline(file, line);
+  return file && line.find("[never]") == std::string::npos;
+}
+
+/* A region of SIZE bytes aligned to the huge page size, so that it can be
+   backed by transparent huge pages.  */
+template <size_t SIZE>
+class Region {
+  void *_map = MAP_FAILED;
+  size_t _map_size = SIZE + huge_page_size;
+
+ public:
+  char *start = nullptr;
+
+  Region() {
+    _map = ::mmap(nullptr, _map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (_map == MAP_FAILED) {
+      assert(0);
+    }
+    start = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(_map) + huge_page_size - 1) & ~(huge_page_size - 1));
+  }
+
+  ~Region() { ::munmap(_map, _map_size); }
+
+  Region(const Region&) = delete;
+  Region& operator=(const Region&) = delete;
+
+  /// Write to every 4 KB page of the region.
+  void populate() {
+    for (size_t offset = 0; offset < SIZE; offset += small_page_size) {
+      start[offset] = 1;
+    }
+  }
+};
+
+/* Every thread advises a region of its own, so the interfering threads
+   contend only for the mm of the process.  */
+template <int ADVICE, Page PAGE, size_t SIZE = 2 * MB>
+struct MadviseAction {
+  static_assert(PAGE != Page::HUGETLB);
+
+  static constexpr bool populates = ADVICE == MADV_POPULATE_READ || ADVICE == MADV_POPULATE_WRITE;
+
+  struct State {
+    const benchmark::ThreadVector& interfering_threads;
+    std::unique_ptr<Region<SIZE>> region = std::make_unique<Region<SIZE>>();
+
+    State(const benchmark::ThreadVector& interfering_threads) : interfering_threads{interfering_threads} {
+      if (::madvise(region->start, SIZE, PAGE == Page::THP ? MADV_HUGEPAGE : MADV_NOHUGEPAGE) < 0) {
+        assert(0);
+      }
+      prepare();
+    }
+
+    /// Put the region into the state that the advice starts from.
+    void prepare() {
+      if (populates) {
+        if (::madvise(region->start, SIZE, MADV_DONTNEED) < 0) {
+          assert(0);
+        }
+        return;
+      }
+      if (ADVICE == MADV_HUGEPAGE && ::madvise(region->start, SIZE, MADV_NOHUGEPAGE) < 0) {
+        assert(0);
+      }
+      region->populate();
+    }
+
+    void advise() {
+      if (::madvise(region->start, SIZE, ADVICE) < 0) {
+        assert(0);
+      }
+    }
+  };
+
+  State make_state(const benchmark::ThreadVector& ts) { return State(ts); }
+
+  void raw_operation(State& state) {
+    state.advise();
+    state.prepare();
+  }
+
+  uint64_t measured_operation(State& state) {
+    uint64_t start = benchmark::clock_start();
+    state.advise();
+    uint64_t end = benchmark::clock_stop();
+    state.prepare();
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(State& state, size_t tid) {
+    raw_operation(state);
+  }
+
+  /// Return false if the kernel does not support the advice or THP.
+  bool supported() {
+    if (PAGE == Page::THP && !thp_enabled()) {
+      return false;
+    }
+    Region<huge_page_size> region;
+    return ::madvise(region.start, huge_page_size, ADVICE) == 0;
+  }
+
+  size_t bytes_per_operation() { return SIZE; }
+
+  bool supports_non_interference() { return true; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+/// Map @size bytes of anonymous memory with @flags, backed by @page.
+template <Page PAGE>
+static void *map_anonymous(void *addr, size_t size, int flags) {
+  if (PAGE == Page::HUGETLB) {
+    flags |= MAP_HUGETLB | MAP_HUGE_2MB;
+  }
+  return ::mmap(addr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+}
+
+template <Page PAGE>
+struct ThpFaultAction {
+  static constexpr size_t size = huge_page_size;
+
+  static inline size_t nr_threads = 0;
+
+  static void init(size_t nr_interfering_threads) { nr_threads = nr_interfering_threads; }
+
+  /// Map a huge page aligned region, or nullptr if it cannot be backed by
+  /// PAGE.
+  static void *map() {
+    if (PAGE == Page::HUGETLB) {
+      void *map = map_anonymous<PAGE>(nullptr, size, 0);
+      return map == MAP_FAILED ? nullptr : map;
+    }
+    /* Map twice the size and trim it to an aligned region.  */
+    char *map = reinterpret_cast<char *>(map_anonymous<PAGE>(nullptr, 2 * size, 0));
+    if (map == MAP_FAILED) {
+      assert(0);
+    }
+    char *start = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(map) + size - 1) & ~(size - 1));
+    if (start != map) {
+      ::munmap(map, start - map);
+    }
+    ::munmap(start + size, map + size - start);
+    if (::madvise(start, size, PAGE == Page::THP ? MADV_HUGEPAGE : MADV_NOHUGEPAGE) < 0) {
+      ::munmap(start, size);
+      return nullptr;
+    }
+    return start;
+  }
+
+  /// Map a region, which must succeed.
+  static void *map_or_abort() {
+    void *start = map();
+    if (!start) {
+      assert(0);
+    }
+    return start;
+  }
+
+  benchmark::NoState make_state(const benchmark::ThreadVector& ts) { return benchmark::NoState(ts); }
+
+  void raw_operation(benchmark::NoState& state) {
+    void *start = map_or_abort();
+    *reinterpret_cast<volatile char *>(start) = 1;
+    ::munmap(start, size);
+  }
+
+  uint64_t measured_operation(benchmark::NoState& state) {
+    void *start = map_or_abort();
+    uint64_t begin = benchmark::clock_start();
+    *reinterpret_cast<volatile char *>(start) = 1;
+    uint64_t end = benchmark::clock_stop();
+    ::munmap(start, size);
+    return benchmark::clock_elapsed(begin, end);
+  }
+
+  void other_operation(benchmark::NoState& state, size_t tid) {
+    raw_operation(state);
+  }
+
+  /// Return false if the measuring thread and every interfering thread
+  /// cannot hold a region at the same time.
+  bool supported() {
+    if (PAGE == Page::THP && !thp_enabled()) {
+      return false;
+    }
+    std::vector<void *> regions;
+    for (size_t i = 0; i < nr_threads + 1; i++) {
+      void *start = map();
+      if (!start) {
+        break;
+      }
+      regions.push_back(start);
+    }
+    for (void *start : regions) {
+      ::munmap(start, size);
+    }
+    return regions.size() == nr_threads + 1;
+  }
+
+  bool supports_non_interference() { return true; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+/// Return a free, huge page aligned address to map @size bytes at.
+static void *free_address(size_t size) {
+  void *start = ThpFaultAction<Page::SMALL>::map();
+  if (!start) {
+    assert(0);
+  }
+  ::munmap(start, size);
+  return start;
+}
+
+/// A free, huge page aligned address that is reserved with an inaccessible
+/// mapping between operations, so that no other mapping of the process can
+/// take it.
+class Reservation {
+  void *_addr;
+  size_t _size;
+
+ public:
+  Reservation(size_t size) : _addr{free_address(size)}, _size{size} { reserve(); }
+
+  ~Reservation() { ::munmap(_addr, _size); }
+
+  Reservation(const Reservation&) = delete;
+  Reservation& operator=(const Reservation&) = delete;
+
+  void *addr() const { return _addr; }
+
+  void reserve() {
+    if (::mmap(_addr, _size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE, -1, 0) != _addr) {
+      assert(0);
+    }
+  }
+
+  void release() { ::munmap(_addr, _size); }
+};
+
+/* Every thread maps at an address of its own. The reservation is released
+   before and taken again after every operation, outside of the measurement,
+   so the energy measurement includes it.  */
+template <Page PAGE>
+struct FixedNoreplaceAction {
+  static constexpr size_t size = huge_page_size;
+
+  static inline size_t nr_threads = 0;
+
+  static void init(size_t nr_interfering_threads) { nr_threads = nr_interfering_threads; }
+
+  struct State {
+    const benchmark::ThreadVector& interfering_threads;
+    std::unique_ptr<Reservation> reservation = std::make_unique<Reservation>(size);
+
+    State(const benchmark::ThreadVector& interfering_threads) : interfering_threads{interfering_threads} {}
+
+    void *map() {
+      void *map = map_anonymous<PAGE>(reservation->addr(), size, MAP_FIXED_NOREPLACE);
+      if (map == MAP_FAILED) {
+        assert(0);
+      }
+      return map;
+    }
+
+    void unmap(void *map) {
+      ::munmap(map, size);
+      reservation->reserve();
+    }
+  };
+
+  State make_state(const benchmark::ThreadVector& ts) { return State(ts); }
+
+  void raw_operation(State& state) {
+    state.reservation->release();
+    state.unmap(state.map());
+  }
+
+  uint64_t measured_operation(State& state) {
+    state.reservation->release();
+    uint64_t start = benchmark::clock_start();
+    void *map = state.map();
+    uint64_t end = benchmark::clock_stop();
+    state.unmap(map);
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(State& state, size_t tid) {
+    raw_operation(state);
+  }
+
+  /// Return false if the kernel does not support MAP_FIXED_NOREPLACE, or
+  /// if the measuring thread and every interfering thread cannot hold a
+  /// hugetlbfs mapping at the same time.
+  bool supported() {
+    std::vector<void *> maps;
+    for (size_t i = 0; i < nr_threads + 1; i++) {
+      void *map = map_anonymous<PAGE>(free_address(size), size, MAP_FIXED_NOREPLACE);
+      if (map == MAP_FAILED) {
+        break;
+      }
+      maps.push_back(map);
+    }
+    for (void *map : maps) {
+      ::munmap(map, size);
+    }
+    return maps.size() == nr_threads + 1;
+  }
+
+  bool supports_non_interference() { return true; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+}  // namespace
+
+#define REGISTER_MADVISE(advice, name)                                                                \
+  REGISTER_BENCHMARK((MadviseAction<advice, Page::SMALL>), name "-4kb");                              \
+  REGISTER_BENCHMARK((MadviseAction<advice, Page::THP>), name "-2mb");                                \
+  REGISTER_BENCHMARK((MadviseAction<advice, Page::SMALL, 64 * MB>), name "-4kb-64mb");                \
+  REGISTER_BENCHMARK((MadviseAction<advice, Page::THP, 64 * MB>), name "-2mb-64mb")
+
+REGISTER_MADVISE(MADV_DONTNEED, "bench-madvise-dontneed");
+REGISTER_MADVISE(MADV_FREE, "bench-madvise-free");
+REGISTER_MADVISE(MADV_COLD, "bench-madvise-cold");
+REGISTER_MADVISE(MADV_PAGEOUT, "bench-madvise-pageout");
+REGISTER_MADVISE(MADV_POPULATE_READ, "bench-madvise-populate-read");
+REGISTER_MADVISE(MADV_POPULATE_WRITE, "bench-madvise-populate-write");
+REGISTER_BENCHMARK((MadviseAction<MADV_HUGEPAGE, Page::SMALL>), "bench-madvise-hugepage-4kb");
+REGISTER_BENCHMARK((MadviseAction<MADV_HUGEPAGE, Page::SMALL, 64 * MB>), "bench-madvise-hugepage-4kb-64mb");
+
+REGISTER_BENCHMARK(ThpFaultAction<Page::THP>, "bench-thp-fault", ThpFaultAction<Page::THP>::init);
+REGISTER_BENCHMARK(ThpFaultAction<Page::HUGETLB>, "bench-thp-fault-hugetlbfs", ThpFaultAction<Page::HUGETLB>::init);
+REGISTER_BENCHMARK(ThpFaultAction<Page::SMALL>, "bench-thp-fault-4kb", ThpFaultAction<Page::SMALL>::init);
+
+REGISTER_BENCHMARK(FixedNoreplaceAction<Page::SMALL>, "bench-mmap-fixed-noreplace-4kb", FixedNoreplaceAction<Page::SMALL>::init);
+REGISTER_BENCHMARK(FixedNoreplaceAction<Page::HUGETLB>, "bench-mmap-fixed-noreplace-2mb", FixedNoreplaceAction<Page::HUGETLB>::init);
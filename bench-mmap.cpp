@@ -0,0 +1,176 @@
+/* mmap() and munmap() benchmarks.
+
+   These benchmarks measure mapping anonymous memory, unmapping it, or both,
+   with the page size, MAP_POPULATE and the size of the mapping as template
+   parameters. Benchmarks are named after the phase that they measure and
+   the page size:
+
+     - bench-mmap-*: mmap().
+     - bench-munmap-*: munmap().
+     - bench-mmap-munmap-*: mmap() and munmap().
+
+   With MAP_POPULATE, they are named bench-mmap-populate-*,
+   bench-munmap-populated-* and bench-mmap-populate-munmap-*. The page size
+   is 4 KB (-4kb), or 2 MB (-2mb) or 1 GB (-1gb) hugetlbfs pages. The
+   hugetlbfs benchmarks are skipped unless enough pages are reserved for the
+   measuring thread and every interfering thread to hold a mapping.
+
+   The mapping is 2 MB, or one page with 1 GB pages. Sweep variants are
+   suffixed with the size of the mapping (e.g. bench-mmap-populate-4kb-64mb)
+   and cover 4 KB to 1 GB in powers of four, so that scripts/plot-size.py
+   can plot the latency against the size of the mapping.  */
+
+#include "benchmark.h"
+
+#include <linux/mman.h>
+#include <sys/mman.h>
+
+#include <vector>
+
+namespace {
+
+static constexpr size_t KB = 1024;
+static constexpr size_t MB = 1024 * KB;
+static constexpr size_t GB = 1024 * MB;
+
+enum class Phase {
+  MAP,
+  UNMAP,
+  MAP_UNMAP,
+};
+
+enum class Page {
+  SIZE_4KB,
+  SIZE_2MB,
+  SIZE_1GB,
+};
+
+template <Phase PHASE, Page PAGE, bool POPULATE, size_t SIZE = 2 * MB>
+struct Action {
+  static inline size_t nr_threads = 0;
+
+  static void init(size_t nr_interfering_threads) { nr_threads = nr_interfering_threads; }
+
+  static constexpr int flags() {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    switch (PAGE) {
+      case Page::SIZE_4KB:
+        break;
+      case Page::SIZE_2MB:
+        flags |= MAP_HUGETLB | MAP_HUGE_2MB;
+        break;
+      case Page::SIZE_1GB:
+        flags |= MAP_HUGETLB | MAP_HUGE_1GB;
+        break;
+    }
+    return POPULATE ? flags | MAP_POPULATE : flags;
+  }
+
+  static void *map() {
+    void *map = ::mmap(nullptr, SIZE, PROT_READ | PROT_WRITE, flags(), -1, 0);
+    assert(map != MAP_FAILED);
+    return map;
+  }
+
+  benchmark::NoState make_state(const benchmark::ThreadVector& ts) { return benchmark::NoState(ts); }
+
+  void raw_operation(benchmark::NoState& state) {
+    ::munmap(map(), SIZE);
+  }
+
+  uint64_t measured_operation(benchmark::NoState& state) {
+    uint64_t start, end;
+    switch (PHASE) {
+      case Phase::MAP: {
+        start = benchmark::clock_start();
+        void *addr = map();
+        end = benchmark::clock_stop();
+        ::munmap(addr, SIZE);
+        break;
+      }
+      case Phase::UNMAP: {
+        void *addr = map();
+        start = benchmark::clock_start();
+        ::munmap(addr, SIZE);
+        end = benchmark::clock_stop();
+        break;
+      }
+      case Phase::MAP_UNMAP:
+        start = benchmark::clock_start();
+        ::munmap(map(), SIZE);
+        end = benchmark::clock_stop();
+        break;
+    }
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(benchmark::NoState& state, size_t tid) {
+    raw_operation(state);
+  }
+
+  /// Return false if not enough hugetlbfs pages of the size are reserved for
+  /// the measuring thread and every interfering thread to hold a mapping at
+  /// the same time.
+  bool supported() {
+    if (PAGE == Page::SIZE_4KB) {
+      return true;
+    }
+    std::vector<void *> maps;
+    for (size_t i = 0; i < nr_threads + 1; i++) {
+      void *map = ::mmap(nullptr, SIZE, PROT_READ | PROT_WRITE, flags(), -1, 0);
+      if (map == MAP_FAILED) {
+        break;
+      }
+      maps.push_back(map);
+    }
+    for (void *map : maps) {
+      ::munmap(map, SIZE);
+    }
+    return maps.size() == nr_threads + 1;
+  }
+
+  size_t bytes_per_operation() { return SIZE; }
+
+  bool supports_non_interference() { return true; }
+
+  /* Energy is measured by repeating raw_operation(), which maps and unmaps,
+     so it is only meaningful when both phases are measured.  */
+  bool supports_energy_measurement() { return PHASE == Phase::MAP_UNMAP; }
+};
+
+}  // namespace
+
+#define REGISTER_MMAP_ACTION(name, ...) REGISTER_BENCHMARK((Action<__VA_ARGS__>), name, Action<__VA_ARGS__>::init)
+
+#define REGISTER_MMAP_4KB(phase, populate, name)                                          \
+  REGISTER_MMAP_ACTION(name "-4kb", phase, Page::SIZE_4KB, populate);                     \
+  REGISTER_MMAP_ACTION(name "-4kb-4kb", phase, Page::SIZE_4KB, populate, 4 * KB);         \
+  REGISTER_MMAP_ACTION(name "-4kb-16kb", phase, Page::SIZE_4KB, populate, 16 * KB);       \
+  REGISTER_MMAP_ACTION(name "-4kb-64kb", phase, Page::SIZE_4KB, populate, 64 * KB);       \
+  REGISTER_MMAP_ACTION(name "-4kb-256kb", phase, Page::SIZE_4KB, populate, 256 * KB);     \
+  REGISTER_MMAP_ACTION(name "-4kb-1mb", phase, Page::SIZE_4KB, populate, 1 * MB);         \
+  REGISTER_MMAP_ACTION(name "-4kb-4mb", phase, Page::SIZE_4KB, populate, 4 * MB);         \
+  REGISTER_MMAP_ACTION(name "-4kb-16mb", phase, Page::SIZE_4KB, populate, 16 * MB);       \
+  REGISTER_MMAP_ACTION(name "-4kb-64mb", phase, Page::SIZE_4KB, populate, 64 * MB);       \
+  REGISTER_MMAP_ACTION(name "-4kb-256mb", phase, Page::SIZE_4KB, populate, 256 * MB);     \
+  REGISTER_MMAP_ACTION(name "-4kb-1gb", phase, Page::SIZE_4KB, populate, 1 * GB)
+
+#define REGISTER_MMAP_HUGE(phase, populate, name)                                         \
+  REGISTER_MMAP_ACTION(name "-2mb", phase, Page::SIZE_2MB, populate);                     \
+  REGISTER_MMAP_ACTION(name "-2mb-4mb", phase, Page::SIZE_2MB, populate, 4 * MB);         \
+  REGISTER_MMAP_ACTION(name "-2mb-16mb", phase, Page::SIZE_2MB, populate, 16 * MB);       \
+  REGISTER_MMAP_ACTION(name "-2mb-64mb", phase, Page::SIZE_2MB, populate, 64 * MB);       \
+  REGISTER_MMAP_ACTION(name "-2mb-256mb", phase, Page::SIZE_2MB, populate, 256 * MB);     \
+  REGISTER_MMAP_ACTION(name "-2mb-1gb", phase, Page::SIZE_2MB, populate, 1 * GB);         \
+  REGISTER_MMAP_ACTION(name "-1gb", phase, Page::SIZE_1GB, populate, 1 * GB)
+
+#define REGISTER_MMAP(phase, populate, name) \
+  REGISTER_MMAP_4KB(phase, populate, name);  \
+  REGISTER_MMAP_HUGE(phase, populate, name)
+
+REGISTER_MMAP(Phase::MAP, false, "bench-mmap");
+REGISTER_MMAP(Phase::UNMAP, false, "bench-munmap");
+REGISTER_MMAP(Phase::MAP_UNMAP, false, "bench-mmap-munmap");
+REGISTER_MMAP(Phase::MAP, true, "bench-mmap-populate");
+REGISTER_MMAP(Phase::UNMAP, true, "bench-munmap-populated");
+REGISTER_MMAP(Phase::MAP_UNMAP, true, "bench-mmap-populate-munmap");
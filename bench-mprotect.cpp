@@ -2,6 +2,8 @@
 
 #include <sys/mman.h>
 
+namespace {
+
 static constexpr size_t size = 1024 * 1024; /* 1 MB */
 
 struct Action {
@@ -24,18 +26,11 @@ struct Action {
   }
 
   uint64_t measured_operation(benchmark::NoState& state) {
-    struct timespec start, end;
-    if (clock_gettime(CLOCK_MONOTONIC, &start) < 0) {
-      assert(0);
-    }
+    uint64_t start = benchmark::clock_start();
     ::mprotect(map, size, PROT_NONE);
-    if (clock_gettime(CLOCK_MONOTONIC, &end) < 0) {
-      assert(0);
-    }
+    uint64_t end = benchmark::clock_stop();
     ::mprotect(map, size, PROT_READ | PROT_WRITE);
-    uint64_t start_ns = benchmark::timespec_to_ns(&start);
-    uint64_t end_ns = benchmark::timespec_to_ns(&end);
-    return end_ns - start_ns;
+    return benchmark::clock_elapsed(start, end);
   }
 
   void other_operation(benchmark::NoState& state, size_t tid) {
@@ -47,7 +42,6 @@ struct Action {
   bool supports_energy_measurement() { return true; }
 };
 
+}  // namespace
 
-int main(int argc, char *argv[]) {
-  benchmark::run_all<Action>(argc, argv);
-}
+REGISTER_BENCHMARK(Action, "bench-mprotect");
@@ -0,0 +1,41 @@
+/* Cross-thread notification benchmarks.
+
+   These benchmarks measure the wakeup delay of the notification mechanisms
+   that an event loop can be woken up with, using the same ping-pong as
+   bench-eventfd.cpp, so that their results are directly comparable across
+   interference scenarios (SMT, multicore, NUMA):
+
+     - pipe: write() and read() of a byte on a pipe.
+     - eventfd, eventfd-poll: eventfd, with the woken thread sleeping in
+       read() or busy-polling with EFD_NONBLOCK.
+     - futex: FUTEX_WAKE and FUTEX_WAIT on a futex word.
+     - condvar: a flag under a mutex and a condition variable.
+     - signal: a real-time signal queued with pthread_sigqueue() and accepted
+       with sigtimedwait().
+     - unix-dgram: a datagram over an AF_UNIX socket pair.
+     - spin: a flag in shared memory that is busy-polled, which is the floor
+       of the other mechanisms.  */
+
+#include "benchmark.h"
+#include "notifier.hh"
+
+namespace {
+
+template <typename Notifier>
+using Action = benchmark::PingPongAction<Notifier>;
+
+static void signal_init(size_t nr_threads) {
+  notifier::Signal::block_signals();
+  Action<notifier::Signal>::init(nr_threads);
+}
+
+}  // namespace
+
+REGISTER_BENCHMARK(Action<notifier::Pipe>, "bench-notify-pipe", Action<notifier::Pipe>::init);
+REGISTER_BENCHMARK(Action<notifier::Eventfd<false>>, "bench-notify-eventfd", Action<notifier::Eventfd<false>>::init);
+REGISTER_BENCHMARK(Action<notifier::Eventfd<true>>, "bench-notify-eventfd-poll", Action<notifier::Eventfd<true>>::init);
+REGISTER_BENCHMARK(Action<notifier::Futex>, "bench-notify-futex", Action<notifier::Futex>::init);
+REGISTER_BENCHMARK(Action<notifier::Condvar>, "bench-notify-condvar", Action<notifier::Condvar>::init);
+REGISTER_BENCHMARK(Action<notifier::Signal>, "bench-notify-signal", signal_init);
+REGISTER_BENCHMARK(Action<notifier::UnixDgram>, "bench-notify-unix-dgram", Action<notifier::UnixDgram>::init);
+REGISTER_BENCHMARK(Action<notifier::Spin>, "bench-notify-spin", Action<notifier::Spin>::init);
@@ -5,12 +5,13 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
-static char filename[PATH_MAX];
+namespace {
+
+static std::string filename;
 
 struct Action {
   Action() {
-    ::strncpy(filename, "tmp-bench-openXXXXXX", PATH_MAX);
-    int fd = mkostemp(filename, O_CREAT);
+    int fd = benchmark::create_work_file("tmp-bench-open", filename, O_CREAT);
     if (fd < 0) {
       assert(0);
     }
@@ -20,7 +21,7 @@ struct Action {
   }
 
   ~Action() {
-    if (::unlink(filename) < 0) {
+    if (::unlink(filename.c_str()) < 0) {
       assert(0);
     }
   }
@@ -28,7 +29,7 @@ struct Action {
   benchmark::NoState make_state(const benchmark::ThreadVector& ts) { return benchmark::NoState(ts); }
 
   void raw_operation(benchmark::NoState& state) {
-    int fd = ::open(filename, O_RDWR);
+    int fd = ::open(filename.c_str(), O_RDWR);
     if (fd < 0) {
       assert(0);
     }
@@ -38,23 +39,16 @@ struct Action {
   }
 
   uint64_t measured_operation(benchmark::NoState& state) {
-    struct timespec start, end;
-    if (clock_gettime(CLOCK_MONOTONIC, &start) < 0) {
-      assert(0);
-    }
-    int fd = ::open(filename, O_RDWR);
+    uint64_t start = benchmark::clock_start();
+    int fd = ::open(filename.c_str(), O_RDWR);
     if (fd < 0) {
       assert(0);
     }
-    if (clock_gettime(CLOCK_MONOTONIC, &end) < 0) {
-      assert(0);
-    }
+    uint64_t end = benchmark::clock_stop();
     if (::close(fd) < 0) {
       assert(0);
     }
-    uint64_t start_ns = benchmark::timespec_to_ns(&start);
-    uint64_t end_ns = benchmark::timespec_to_ns(&end);
-    return end_ns - start_ns;
+    return benchmark::clock_elapsed(start, end);
   }
 
   void other_operation(benchmark::NoState& state, size_t tid) {
@@ -66,4 +60,6 @@ struct Action {
   bool supports_energy_measurement() { return true; }
 };
 
-int main(int argc, char *argv[]) { benchmark::run_all<Action>(argc, argv); }
+}  // namespace
+
+REGISTER_BENCHMARK(Action, "bench-open");
@@ -4,6 +4,8 @@
 #include <sys/mman.h>
 #include <linux/mman.h>
 
+namespace {
+
 static constexpr size_t size = 2 * 1024 * 1024; /* 2 MB */
 
 struct Action {
@@ -20,19 +22,12 @@ struct Action {
   uint64_t measured_operation(benchmark::NoState& state) {
     void *map = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
     assert(map != MAP_FAILED);
-    struct timespec start, end;
-    if (clock_gettime(CLOCK_MONOTONIC, &start) < 0) {
-      assert(0);
-    }
+    uint64_t start = benchmark::clock_start();
     auto *p = reinterpret_cast<volatile unsigned long*>(map);
     memory::force_read(p);
-    if (clock_gettime(CLOCK_MONOTONIC, &end) < 0) {
-      assert(0);
-    }
+    uint64_t end = benchmark::clock_stop();
     ::munmap(map, size);
-    uint64_t start_ns = benchmark::timespec_to_ns(&start);
-    uint64_t end_ns = benchmark::timespec_to_ns(&end);
-    return end_ns - start_ns;
+    return benchmark::clock_elapsed(start, end);
   }
 
   void other_operation(benchmark::NoState& state, size_t tid) {
@@ -44,7 +39,6 @@ struct Action {
   bool supports_energy_measurement() { return true; }
 };
 
+}  // namespace
 
-int main(int argc, char *argv[]) {
-  benchmark::run_all<Action>(argc, argv);
-}
+REGISTER_BENCHMARK(Action, "bench-pagefault-large");
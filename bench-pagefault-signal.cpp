@@ -3,17 +3,14 @@
 
 #include <sys/mman.h>
 
+namespace {
+
 const size_t page_size = 4096;
 
-static thread_local std::atomic<uint64_t> end_ns;
+static thread_local std::atomic<uint64_t> end;
 
 static void sigaction_segv(int signal, siginfo_t *si, void *arg) {
-  struct timespec end;
-
-  if (clock_gettime(CLOCK_MONOTONIC, &end) < 0) {
-    assert(0);
-  }
-  end_ns = benchmark::timespec_to_ns(&end);
+  end = benchmark::clock_stop();
 
   ucontext_t *ctx = (ucontext_t *) arg;
 
@@ -37,6 +34,7 @@ struct Action {
   }
 
   ~Action() {
+    ::signal(SIGSEGV, SIG_DFL);
     ::munmap(map, page_size);
   }
 
@@ -55,13 +53,9 @@ struct Action {
   }
 
   uint64_t measured_operation(benchmark::NoState& state) {
-    struct timespec start;
-    if (clock_gettime(CLOCK_MONOTONIC, &start) < 0) {
-      assert(0);
-    }
+    uint64_t start = benchmark::clock_start();
     raw_operation(state);
-    uint64_t start_ns = benchmark::timespec_to_ns(&start);
-    return end_ns - start_ns;
+    return benchmark::clock_elapsed(start, end);
   }
 
   void other_operation(benchmark::NoState& state, size_t tid) {
@@ -73,8 +67,6 @@ struct Action {
   bool supports_energy_measurement() { return true; }
 };
 
+}  // namespace
 
-int main(int argc, char *argv[]) {
-  benchmark::run_all<Action>(argc, argv);
-}
-
+REGISTER_BENCHMARK(Action, "bench-pagefault-signal");
@@ -3,6 +3,8 @@
 
 #include <sys/mman.h>
 
+namespace {
+
 static constexpr size_t size = 4 * 1024; /* 4 KB */
 
 struct Action {
@@ -19,19 +21,12 @@ struct Action {
   uint64_t measured_operation(benchmark::NoState& state) {
     void *map = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
     assert(map != MAP_FAILED);
-    struct timespec start, end;
-    if (clock_gettime(CLOCK_MONOTONIC, &start) < 0) {
-      assert(0);
-    }
+    uint64_t start = benchmark::clock_start();
     auto *p = reinterpret_cast<volatile unsigned long*>(map);
     memory::force_read(p);
-    if (clock_gettime(CLOCK_MONOTONIC, &end) < 0) {
-      assert(0);
-    }
+    uint64_t end = benchmark::clock_stop();
     ::munmap(map, size);
-    uint64_t start_ns = benchmark::timespec_to_ns(&start);
-    uint64_t end_ns = benchmark::timespec_to_ns(&end);
-    return end_ns - start_ns;
+    return benchmark::clock_elapsed(start, end);
   }
 
   void other_operation(benchmark::NoState& state, size_t tid) {
@@ -43,7 +38,6 @@ struct Action {
   bool supports_energy_measurement() { return true; }
 };
 
+}  // namespace
 
-int main(int argc, char *argv[]) {
-  benchmark::run_all<Action>(argc, argv);
-}
+REGISTER_BENCHMARK(Action, "bench-pagefault-small");
@@ -0,0 +1,383 @@
+/* Page fault benchmarks.
+
+   bench-pagefault-small and bench-pagefault-large measure a read fault on
+   anonymous memory, which maps the zero page. These benchmarks measure the
+   faults that are more common in practice:
+
+     - write-small, write-large: a write fault on anonymous memory, which
+       allocates and zeroes a 4 KB page or a 2 MB hugetlbfs page.
+       write-large is skipped unless enough pages are reserved for the
+       measuring thread and every interfering thread to hold one.
+     - cow: a copy-on-write fault in a child process, which writes to a page
+       that it shares with its parent after fork(). The child measures the
+       fault and passes the latency to the parent in shared memory.
+     - file-{shared,private}-{read,write}-{hot,cold}: a read or write fault
+       on a 4 KB MAP_SHARED or MAP_PRIVATE mapping of a tmpfs file (a
+       memfd). The page is in the page cache with -hot and is punched out of
+       the file after every operation with -cold, so that the fault allocates
+       it.
+     - sequential-{anon,file-read,file-write}: touching every page of a new 2
+       MB mapping in order, which also reports the throughput. Read faults on
+       files map the pages around the faulting one that are in the page cache
+       (fault-around, see /sys/kernel/debug/fault_around_bytes), so that
+       sequential-file-read takes one fault every 16 pages by default, while
+       anonymous and shared write faults map one page per fault.
+
+   Every thread faults on a mapping of its own, so the interfering threads
+   contend only for the mm of the process.  */
+
+#include "benchmark.h"
+#include "memory.hh"
+
+#include <fcntl.h>
+#include <linux/mman.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <memory>
+#include <vector>
+
+namespace {
+
+static constexpr size_t KB = 1024;
+static constexpr size_t MB = 1024 * KB;
+
+static constexpr size_t page_size = 4 * KB;
+
+enum class Page {
+  SMALL,
+  LARGE,
+};
+
+enum class Sharing {
+  SHARED,
+  PRIVATE,
+};
+
+enum class Access {
+  READ,
+  WRITE,
+};
+
+enum class Cache {
+  HOT,
+  COLD,
+};
+
+enum class Backing {
+  ANON,
+  FILE_READ,
+  FILE_WRITE,
+};
+
+/// Fault on @addr with a read or a write.
+template <Access ACCESS>
+static void touch(void *addr) {
+  auto *p = reinterpret_cast<volatile unsigned long *>(addr);
+  if (ACCESS == Access::READ) {
+    memory::force_read(p);
+  } else {
+    memory::force_write(p, 1UL);
+  }
+}
+
+/// A tmpfs file of @size bytes, whose pages are in the page cache.
+class File {
+  size_t _size;
+
+ public:
+  int fd = -1;
+
+  File(size_t size) : _size{size} {
+    fd = ::memfd_create("posixbench", MFD_CLOEXEC);
+    if (fd < 0 || ::ftruncate(fd, size) < 0) {
+      assert(0);
+    }
+    populate();
+  }
+
+  ~File() { ::close(fd); }
+
+  File(const File&) = delete;
+  File& operator=(const File&) = delete;
+
+  /// Allocate every page of the file in the page cache.
+  void populate() {
+    if (::fallocate(fd, 0, 0, _size) < 0) {
+      assert(0);
+    }
+  }
+
+  /// Remove every page of the file from the page cache.
+  void punch() {
+    if (::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0, _size) < 0) {
+      assert(0);
+    }
+  }
+};
+
+template <Page PAGE>
+struct WriteFaultAction {
+  static constexpr size_t size = PAGE == Page::SMALL ? page_size : 2 * MB;
+  static constexpr int flags = MAP_PRIVATE | MAP_ANONYMOUS | (PAGE == Page::LARGE ? MAP_HUGETLB | MAP_HUGE_2MB : 0);
+
+  static inline size_t nr_threads = 0;
+
+  static void init(size_t nr_interfering_threads) { nr_threads = nr_interfering_threads; }
+
+  benchmark::NoState make_state(const benchmark::ThreadVector& ts) { return benchmark::NoState(ts); }
+
+  void raw_operation(benchmark::NoState& state) {
+    void *map = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    assert(map != MAP_FAILED);
+    touch<Access::WRITE>(map);
+    ::munmap(map, size);
+  }
+
+  uint64_t measured_operation(benchmark::NoState& state) {
+    void *map = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    assert(map != MAP_FAILED);
+    uint64_t start = benchmark::clock_start();
+    touch<Access::WRITE>(map);
+    uint64_t end = benchmark::clock_stop();
+    ::munmap(map, size);
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(benchmark::NoState& state, size_t tid) {
+    raw_operation(state);
+  }
+
+  /// Return false if not enough hugetlbfs pages are reserved for the
+  /// measuring thread and every interfering thread to hold a mapping at the
+  /// same time.
+  bool supported() {
+    std::vector<void *> maps;
+    for (size_t i = 0; i < nr_threads + 1; i++) {
+      void *map = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+      if (map == MAP_FAILED) {
+        break;
+      }
+      maps.push_back(map);
+    }
+    for (void *map : maps) {
+      ::munmap(map, size);
+    }
+    return maps.size() == nr_threads + 1;
+  }
+
+  bool supports_non_interference() { return true; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+static void wait_for(pid_t pid) {
+  int status;
+  while (::waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      assert(0);
+    }
+  }
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    assert(0);
+  }
+}
+
+/* fork() write-protects the populated page in the parent and the child, so
+   the first write in the child copies it. The page is exclusive to the
+   parent again once the child has exited.  */
+struct CowFaultAction {
+  void *page = MAP_FAILED;
+  /// Latency measured by the child, shared with the parent.
+  uint64_t *result = nullptr;
+
+  CowFaultAction() {
+    page = ::mmap(nullptr, page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    void *shared = ::mmap(nullptr, page_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (page == MAP_FAILED || shared == MAP_FAILED) {
+      assert(0);
+    }
+    touch<Access::WRITE>(page);
+    result = reinterpret_cast<uint64_t *>(shared);
+  }
+
+  ~CowFaultAction() {
+    ::munmap(page, page_size);
+    ::munmap(result, page_size);
+  }
+
+  benchmark::NoState make_state(const benchmark::ThreadVector& ts) { return benchmark::NoState(ts); }
+
+  void raw_operation(benchmark::NoState& state) {
+    pid_t pid = ::fork();
+    if (pid == 0) {
+      touch<Access::WRITE>(page);
+      ::_exit(0);
+    }
+    if (pid < 0) {
+      assert(0);
+    }
+    wait_for(pid);
+  }
+
+  uint64_t measured_operation(benchmark::NoState& state) {
+    pid_t pid = ::fork();
+    if (pid == 0) {
+      /* Calling clock_start() copies the page of the stack before the
+         measurement starts.  */
+      uint64_t start = benchmark::clock_start();
+      touch<Access::WRITE>(page);
+      uint64_t end = benchmark::clock_stop();
+      *result = benchmark::clock_elapsed(start, end);
+      ::_exit(0);
+    }
+    if (pid < 0) {
+      assert(0);
+    }
+    wait_for(pid);
+    return *result;
+  }
+
+  void other_operation(benchmark::NoState& state, size_t tid) {
+    raw_operation(state);
+  }
+
+  bool supports_non_interference() { return true; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+template <Sharing SHARING, Access ACCESS, Cache CACHE>
+struct FileFaultAction {
+  static constexpr int flags = SHARING == Sharing::SHARED ? MAP_SHARED : MAP_PRIVATE;
+
+  struct State {
+    const benchmark::ThreadVector& interfering_threads;
+    std::unique_ptr<File> file = std::make_unique<File>(page_size);
+
+    State(const benchmark::ThreadVector& interfering_threads) : interfering_threads{interfering_threads} {
+      prepare();
+    }
+
+    /// Put the page cache into the state that the fault starts from.
+    void prepare() {
+      if (CACHE == Cache::COLD) {
+        file->punch();
+      }
+    }
+
+    void *map() {
+      void *map = ::mmap(nullptr, page_size, PROT_READ | PROT_WRITE, flags, file->fd, 0);
+      assert(map != MAP_FAILED);
+      return map;
+    }
+  };
+
+  State make_state(const benchmark::ThreadVector& ts) { return State(ts); }
+
+  void raw_operation(State& state) {
+    void *map = state.map();
+    touch<ACCESS>(map);
+    ::munmap(map, page_size);
+    state.prepare();
+  }
+
+  uint64_t measured_operation(State& state) {
+    void *map = state.map();
+    uint64_t start = benchmark::clock_start();
+    touch<ACCESS>(map);
+    uint64_t end = benchmark::clock_stop();
+    ::munmap(map, page_size);
+    state.prepare();
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(State& state, size_t tid) {
+    raw_operation(state);
+  }
+
+  bool supports_non_interference() { return true; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+template <Backing BACKING, size_t SIZE = 2 * MB>
+struct SequentialAction {
+  static constexpr Access access = BACKING == Backing::FILE_READ ? Access::READ : Access::WRITE;
+
+  struct State {
+    const benchmark::ThreadVector& interfering_threads;
+    std::unique_ptr<File> file = BACKING == Backing::ANON ? nullptr : std::make_unique<File>(SIZE);
+
+    State(const benchmark::ThreadVector& interfering_threads) : interfering_threads{interfering_threads} {}
+
+    void *map() {
+      void *map;
+      if (BACKING == Backing::ANON) {
+        map = ::mmap(nullptr, SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        assert(map != MAP_FAILED);
+        /* Fault 4 KB pages even if transparent huge pages are enabled.  */
+        ::madvise(map, SIZE, MADV_NOHUGEPAGE);
+      } else {
+        map = ::mmap(nullptr, SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+        assert(map != MAP_FAILED);
+      }
+      return map;
+    }
+  };
+
+  static void touch_all(void *map) {
+    char *start = reinterpret_cast<char *>(map);
+    for (size_t offset = 0; offset < SIZE; offset += page_size) {
+      touch<access>(start + offset);
+    }
+  }
+
+  State make_state(const benchmark::ThreadVector& ts) { return State(ts); }
+
+  void raw_operation(State& state) {
+    void *map = state.map();
+    touch_all(map);
+    ::munmap(map, SIZE);
+  }
+
+  uint64_t measured_operation(State& state) {
+    void *map = state.map();
+    uint64_t start = benchmark::clock_start();
+    touch_all(map);
+    uint64_t end = benchmark::clock_stop();
+    ::munmap(map, SIZE);
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(State& state, size_t tid) {
+    raw_operation(state);
+  }
+
+  size_t bytes_per_operation() { return SIZE; }
+
+  bool supports_non_interference() { return true; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+}  // namespace
+
+#define REGISTER_FILE_FAULT(sharing, access, name)                                 \
+  REGISTER_BENCHMARK((FileFaultAction<sharing, access, Cache::HOT>), name "-hot"); \
+  REGISTER_BENCHMARK((FileFaultAction<sharing, access, Cache::COLD>), name "-cold")
+
+REGISTER_BENCHMARK(WriteFaultAction<Page::SMALL>, "bench-pagefault-write-small", WriteFaultAction<Page::SMALL>::init);
+REGISTER_BENCHMARK(WriteFaultAction<Page::LARGE>, "bench-pagefault-write-large", WriteFaultAction<Page::LARGE>::init);
+
+REGISTER_BENCHMARK(CowFaultAction, "bench-pagefault-cow");
+
+REGISTER_FILE_FAULT(Sharing::SHARED, Access::READ, "bench-pagefault-file-shared-read");
+REGISTER_FILE_FAULT(Sharing::SHARED, Access::WRITE, "bench-pagefault-file-shared-write");
+REGISTER_FILE_FAULT(Sharing::PRIVATE, Access::READ, "bench-pagefault-file-private-read");
+REGISTER_FILE_FAULT(Sharing::PRIVATE, Access::WRITE, "bench-pagefault-file-private-write");
+
+REGISTER_BENCHMARK(SequentialAction<Backing::ANON>, "bench-pagefault-sequential-anon");
+REGISTER_BENCHMARK(SequentialAction<Backing::FILE_READ>, "bench-pagefault-sequential-file-read");
+REGISTER_BENCHMARK(SequentialAction<Backing::FILE_WRITE>, "bench-pagefault-sequential-file-write");
@@ -0,0 +1,301 @@
+/* Process lifecycle benchmarks.
+
+   These benchmarks measure creating a process that exits immediately and
+   waiting for it with waitpid():
+
+     - fork: fork() and _exit() in the child.
+     - vfork: vfork() and _exit() in the child.
+     - spawn: posix_spawn() of the posixbench-exit helper.
+     - clone3-vm: clone3() with CLONE_VM, where the child calls exit()
+       without touching memory.
+     - fork-exec: fork() and execve() of the posixbench-exit helper.
+
+   The cost of copying the address space grows with the memory that the
+   parent has mapped. Variants map and touch 64 MB or 1 GB in the parent
+   before the measurement, in 4 KB pages (-4k-) or in transparent huge pages
+   (-2m-). The -dontfork- and -2m-dontfork- variants mark the 4 KB or huge
+   page mapping MADV_DONTFORK, which keeps it out of the child. The -2m-
+   variants are skipped if transparent huge pages are disabled. The
+   posixbench-exit helper is expected in the directory of the posixbench
+   executable.  */
+
+#include "benchmark.h"
+
+#include <libgen.h>
+#include <limits.h>
+#include <linux/sched.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+
+extern char **environ;
+
+namespace {
+
+static constexpr size_t MB = 1024 * 1024;
+static constexpr size_t GB = 1024 * MB;
+
+static constexpr size_t huge_page_size = 2 * MB;
+
+enum class Op {
+  FORK,
+  VFORK,
+  SPAWN,
+  CLONE3_VM,
+  FORK_EXEC,
+};
+
+enum class Memory {
+  NONE,
+  SMALL,
+  HUGE,
+};
+
+/// Return true if transparent huge pages can be enabled with madvise().
+static bool thp_enabled() {
+  std::ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+  std::string line;
+  std::getline(file, line);
+  return file && line.find("[never]") == std::string::npos;
+}
+
+/// Return the path of the posixbench-exit helper.
+static std::string helper_path() {
+  char exe[PATH_MAX];
+  ssize_t len = ::readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+  if (len < 0) {
+    return "";
+  }
+  exe[len] = '\0';
+  return std::string(::dirname(exe)) + "/posixbench-exit";
+}
+
+static void wait_for(pid_t pid) {
+  int status;
+  while (::waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      assert(0);
+    }
+  }
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    assert(0);
+  }
+}
+
+/* Create a child process with clone3() and return its PID in the parent. The
+   child shares the memory of the parent, so it exits with the exit system
+   call right after clone3() returns, without touching the stack.  */
+static long clone3_and_exit(struct clone_args *args) {
+  long ret;
+#if defined(__x86_64__)
+  asm volatile(
+      "syscall\n\t"
+      "test %%rax, %%rax\n\t"
+      "jnz 1f\n\t"
+      "mov %[sys_exit], %%eax\n\t"
+      "xor %%edi, %%edi\n\t"
+      "syscall\n\t"
+      "1:"
+      : "=a"(ret)
+      : "0"(SYS_clone3), "D"(args), "S"(sizeof(*args)), [sys_exit] "i"(SYS_exit)
+      : "rcx", "r11", "memory");
+#elif defined(__aarch64__)
+  register long x0 asm("x0") = reinterpret_cast<long>(args);
+  register long x1 asm("x1") = sizeof(*args);
+  register long x8 asm("x8") = SYS_clone3;
+  asm volatile(
+      "svc #0\n\t"
+      "cbnz x0, 1f\n\t"
+      "mov x8, %[sys_exit]\n\t"
+      "svc #0\n\t"
+      "1:"
+      : "+r"(x0)
+      : "r"(x1), "r"(x8), [sys_exit] "i"(SYS_exit)
+      : "memory");
+  ret = x0;
+#else
+  ret = -ENOSYS;
+#endif
+  if (ret < 0) {
+    errno = -ret;
+    return -1;
+  }
+  return ret;
+}
+
+static bool supports_clone3() {
+#if defined(__x86_64__) || defined(__aarch64__)
+  struct clone_args args = {};
+  args.exit_signal = SIGCHLD;
+  args.flags = CLONE_VM;
+  long pid = clone3_and_exit(&args);
+  if (pid < 0) {
+    return false;
+  }
+  wait_for(pid);
+  return true;
+#else
+  return false;
+#endif
+}
+
+struct State {
+  const benchmark::ThreadVector& interfering_threads;
+  /// Stack of a clone3() child, which it does not touch.
+  std::vector<char> stack = std::vector<char>(64 * 1024);
+
+  State(const benchmark::ThreadVector& interfering_threads) : interfering_threads{interfering_threads} {}
+};
+
+template <Op OP, Memory MEMORY = Memory::NONE, size_t SIZE = 0, bool DONTFORK = false>
+struct Action {
+  std::string helper = helper_path();
+  void *map = MAP_FAILED;
+  size_t map_size = 0;
+  /// False if the kernel does not support transparent huge pages.
+  bool ok = true;
+
+  /* Map and touch SIZE bytes of memory that every created process inherits,
+     unless it is MADV_DONTFORK.  */
+  Action() {
+    if (MEMORY == Memory::NONE) {
+      return;
+    }
+    /* madvise(MADV_HUGEPAGE) succeeds even if transparent huge pages are
+       disabled.  */
+    if (MEMORY == Memory::HUGE && !thp_enabled()) {
+      ok = false;
+      return;
+    }
+    map_size = SIZE + huge_page_size;
+    map = ::mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+      assert(0);
+    }
+    char *start = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(map) + huge_page_size - 1) & ~(huge_page_size - 1));
+    /* Without THP, MADV_NOHUGEPAGE fails but memory is 4 KB pages anyway.  */
+    int advice = MEMORY == Memory::HUGE ? MADV_HUGEPAGE : MADV_NOHUGEPAGE;
+    if (::madvise(start, SIZE, advice) < 0 && MEMORY == Memory::HUGE) {
+      ok = false;
+      return;
+    }
+    if (DONTFORK && ::madvise(start, SIZE, MADV_DONTFORK) < 0) {
+      assert(0);
+    }
+    ::memset(start, 1, SIZE);
+  }
+
+  ~Action() {
+    if (map != MAP_FAILED) {
+      ::munmap(map, map_size);
+    }
+  }
+
+  State make_state(const benchmark::ThreadVector& ts) { return State(ts); }
+
+  pid_t create(State& state) {
+    pid_t pid;
+    switch (OP) {
+      case Op::FORK:
+        pid = ::fork();
+        if (pid == 0) {
+          ::_exit(0);
+        }
+        break;
+      case Op::VFORK:
+        pid = ::vfork();
+        if (pid == 0) {
+          ::_exit(0);
+        }
+        break;
+      case Op::SPAWN: {
+        char *argv[] = {const_cast<char *>(helper.c_str()), nullptr};
+        int err = ::posix_spawn(&pid, helper.c_str(), nullptr, nullptr, argv, environ);
+        if (err) {
+          errno = err;
+          pid = -1;
+        }
+        break;
+      }
+      case Op::CLONE3_VM: {
+        struct clone_args args = {};
+        args.flags = CLONE_VM;
+        args.exit_signal = SIGCHLD;
+        args.stack = reinterpret_cast<uintptr_t>(state.stack.data());
+        args.stack_size = state.stack.size();
+        pid = clone3_and_exit(&args);
+        break;
+      }
+      case Op::FORK_EXEC:
+        pid = ::fork();
+        if (pid == 0) {
+          char *argv[] = {const_cast<char *>(helper.c_str()), nullptr};
+          ::execve(helper.c_str(), argv, environ);
+          ::_exit(127);
+        }
+        break;
+    }
+    if (pid < 0) {
+      assert(0);
+    }
+    return pid;
+  }
+
+  void raw_operation(State& state) {
+    wait_for(create(state));
+  }
+
+  uint64_t measured_operation(State& state) {
+    uint64_t start = benchmark::clock_start();
+    raw_operation(state);
+    uint64_t end = benchmark::clock_stop();
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(State& state, size_t tid) {
+    raw_operation(state);
+  }
+
+  bool supported() {
+    if (!ok) {
+      return false;
+    }
+    switch (OP) {
+      case Op::SPAWN:
+      case Op::FORK_EXEC:
+        return ::access(helper.c_str(), X_OK) == 0;
+      case Op::CLONE3_VM:
+        return supports_clone3();
+      default:
+        return true;
+    }
+  }
+
+  bool supports_non_interference() { return true; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+}  // namespace
+
+#define REGISTER_PROCESS(op, name)                                                          \
+  REGISTER_BENCHMARK(Action<op>, name);                                                     \
+  REGISTER_BENCHMARK((Action<op, Memory::SMALL, 64 * MB>), name "-4k-64mb");                \
+  REGISTER_BENCHMARK((Action<op, Memory::SMALL, 1 * GB>), name "-4k-1gb");                  \
+  REGISTER_BENCHMARK((Action<op, Memory::HUGE, 64 * MB>), name "-2m-64mb");                 \
+  REGISTER_BENCHMARK((Action<op, Memory::HUGE, 1 * GB>), name "-2m-1gb");                   \
+  REGISTER_BENCHMARK((Action<op, Memory::SMALL, 64 * MB, true>), name "-dontfork-64mb");    \
+  REGISTER_BENCHMARK((Action<op, Memory::SMALL, 1 * GB, true>), name "-dontfork-1gb");      \
+  REGISTER_BENCHMARK((Action<op, Memory::HUGE, 64 * MB, true>), name "-2m-dontfork-64mb");  \
+  REGISTER_BENCHMARK((Action<op, Memory::HUGE, 1 * GB, true>), name "-2m-dontfork-1gb")
+
+REGISTER_PROCESS(Op::FORK, "bench-process-fork");
+REGISTER_PROCESS(Op::VFORK, "bench-process-vfork");
+REGISTER_PROCESS(Op::SPAWN, "bench-process-spawn");
+REGISTER_PROCESS(Op::CLONE3_VM, "bench-process-clone3-vm");
+REGISTER_PROCESS(Op::FORK_EXEC, "bench-process-fork-exec");
@@ -4,6 +4,8 @@
 
 #include <pthread.h>
 
+namespace {
+
 struct Action {
   benchmark::NoState make_state(const benchmark::ThreadVector& ts) { return benchmark::NoState(ts); }
 
@@ -14,17 +16,13 @@ struct Action {
   }
 
   uint64_t measured_operation(benchmark::NoState& state) {
-    struct timespec start, end;
-    if (clock_gettime(CLOCK_MONOTONIC, &start) < 0) {
-      assert(0);
-    }
+    uint64_t start = benchmark::clock_start();
+    uint64_t end;
     std::thread t([&end] {
-      if (clock_gettime(CLOCK_MONOTONIC, &end) < 0) {
-        assert(0);
-      }
+      end = benchmark::clock_stop();
     });
     t.join();
-    return benchmark::timespec_to_ns(&end) - benchmark::timespec_to_ns(&start);
+    return benchmark::clock_elapsed(start, end);
   }
 
   void other_operation(benchmark::NoState& state, size_t tid) {
@@ -36,6 +34,6 @@ struct Action {
   bool supports_energy_measurement() { return true; }
 };
 
-int main(int argc, char *argv[]) {
-  benchmark::run_all<Action>(argc, argv);
-}
+}  // namespace
+
+REGISTER_BENCHMARK(Action, "bench-pthread-create");
@@ -3,6 +3,8 @@
 #include <deque>
 #include <vector>
 
+namespace {
+
 static std::vector<uint64_t> remote_timestamps;
 static std::deque<bool> signaled; /* protected by "mutexes" */
 static std::vector<pthread_cond_t> cond_vars;
@@ -38,10 +40,7 @@ struct Action {
 
   uint64_t measured_operation(benchmark::NoState& state) {
     auto other_thread = const_cast<std::thread&>(state.interfering_threads[remote_tid]).native_handle();
-    struct timespec start;
-    if (clock_gettime(CLOCK_MONOTONIC, &start) < 0) {
-      assert(0);
-    }
+    uint64_t start = benchmark::clock_start();
     ::pthread_mutex_lock(&mutexes[remote_tid]);
     signaled[remote_tid] = false;
     ::pthread_kill(other_thread, SIGUSR1);
@@ -49,11 +48,9 @@ struct Action {
       ::pthread_cond_wait(&cond_vars[remote_tid], &mutexes[remote_tid]);
     }
     ::pthread_mutex_unlock(&mutexes[remote_tid]);
-    uint64_t start_ns = benchmark::timespec_to_ns(&start);
-    uint64_t end_ns = remote_timestamps[remote_tid];
+    uint64_t end = remote_timestamps[remote_tid];
     remote_tid = (remote_tid + 1) % remote_timestamps.size();
-    assert(end_ns > start_ns);
-    return end_ns - start_ns;
+    return benchmark::clock_elapsed(start, end);
   }
 
   void other_operation(benchmark::NoState& state, size_t tid) {
@@ -65,12 +62,9 @@ struct Action {
     timeout.tv_sec = 5;
     timeout.tv_nsec = 0;
     int sig = ::sigtimedwait(&set, &info, &timeout);
-    struct timespec now;
-    if (clock_gettime(CLOCK_MONOTONIC, &now) < 0) {
-      assert(0);
-    }
+    uint64_t now = benchmark::clock_stop();
     assert(sig == -1 || sig == SIGUSR1);
-    remote_timestamps[tid] = benchmark::timespec_to_ns(&now);
+    remote_timestamps[tid] = now;
     ::pthread_mutex_lock(&mutexes[tid]);
     signaled[tid] = true;
     ::pthread_cond_signal(&cond_vars[tid]);
@@ -83,6 +77,10 @@ struct Action {
 };
 
 static void init(size_t nr_threads) {
+  ::sigset_t blocked_sigs;
+  ::sigemptyset(&blocked_sigs);
+  ::sigaddset(&blocked_sigs, SIGUSR1);
+  assert(::sigprocmask(SIG_SETMASK, &blocked_sigs, nullptr) == 0);
   for (unsigned i = 0; i < nr_threads; i++) {
     remote_timestamps.push_back(0);
     signaled.push_back(false);
@@ -91,10 +89,6 @@ static void init(size_t nr_threads) {
   }
 }
 
-int main(int argc, char *argv[]) {
-  ::sigset_t blocked_sigs;
-  ::sigemptyset(&blocked_sigs);
-  ::sigaddset(&blocked_sigs, SIGUSR1);
-  assert(::sigprocmask(SIG_SETMASK, &blocked_sigs, nullptr) == 0);
-  benchmark::run_all<Action>(argc, argv, init);
-}
+}  // namespace
+
+REGISTER_BENCHMARK(Action, "bench-pthread-kill", init);
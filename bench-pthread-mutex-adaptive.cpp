@@ -2,6 +2,8 @@
 
 #include <pthread.h>
 
+namespace {
+
 static pthread_mutexattr_t mutex_attr;
 
 struct Op {
@@ -12,6 +14,6 @@ struct Op {
   }
 };
 
-int main(int argc, char *argv[]) {
-  benchmark::run_all<benchmark::SymmetricAction<Op>>(argc, argv);
-}
+}  // namespace
+
+REGISTER_BENCHMARK(benchmark::SymmetricAction<Op>, "bench-pthread-mutex-adaptive");
@@ -2,6 +2,8 @@
 
 #include <pthread.h>
 
+namespace {
+
 struct Op {
   void operator()(benchmark::NoState& state) {
     static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
@@ -10,6 +12,6 @@ struct Op {
   }
 };
 
-int main(int argc, char *argv[]) {
-  benchmark::run_all<benchmark::SymmetricAction<Op>>(argc, argv);
-}
+}  // namespace
+
+REGISTER_BENCHMARK(benchmark::SymmetricAction<Op>, "bench-pthread-mutex");
@@ -1,5 +1,7 @@
 #include "benchmark.h"
 
+namespace {
+
 struct Op {
   void operator()(benchmark::NoState& state) {
     static pthread_rwlock_t lock = PTHREAD_RWLOCK_INITIALIZER;
@@ -8,6 +10,6 @@ struct Op {
   }
 };
 
-int main(int argc, char *argv[]) {
-  benchmark::run_all<benchmark::SymmetricAction<Op>>(argc, argv);
-}
+}  // namespace
+
+REGISTER_BENCHMARK(benchmark::SymmetricAction<Op>, "bench-pthread-rwlock-rd");
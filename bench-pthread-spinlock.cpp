@@ -3,9 +3,11 @@
 #include <assert.h>
 #include <pthread.h>
 
+namespace {
+
 static pthread_spinlock_t lock;
 
-static void init() {
+static void init(size_t nr_threads) {
   if (pthread_spin_init(&lock, 0) != 0) {
     assert(0);
   }
@@ -18,7 +20,6 @@ struct Op {
   }
 };
 
-int main(int argc, char *argv[]) {
-  init();
-  benchmark::run_all<benchmark::SymmetricAction<Op>>(argc, argv);
-}
+}  // namespace
+
+REGISTER_BENCHMARK(benchmark::SymmetricAction<Op>, "bench-pthread-spinlock", init);
@@ -1,9 +1,11 @@
 #include "benchmark.h"
 
+namespace {
+
 struct Op {
   void operator()(benchmark::NoState& state) { pthread_yield(); }
 };
 
-int main(int argc, char *argv[]) {
-  benchmark::run_all<benchmark::SymmetricAction<Op>>(argc, argv);
-}
+}  // namespace
+
+REGISTER_BENCHMARK(benchmark::SymmetricAction<Op>, "bench-pthread-yield");
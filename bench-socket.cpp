@@ -0,0 +1,468 @@
+/* Socket benchmarks over loopback and AF_UNIX.
+
+   These benchmarks measure the local cost of the socket layer, without a
+   network. The measuring thread is the client and the interfering threads are
+   servers, so the interference scenarios place the server at the SMT, core
+   or NUMA distance from the client. With more than one interfering thread,
+   the client talks to the servers round-robin over a connection per server.
+
+     - bench-socket-*-rr-*: round-trip time of a request that the server
+       echoes back, for TCP and UDP over loopback and AF_UNIX stream and
+       datagram sockets. Variants set TCP_NODELAY or SO_BUSY_POLL.
+     - bench-socket-*-bulk: time to send 64 KB to a server that discards the
+       data, which is limited by the socket buffers in steady state and is
+       reported as throughput. The zero-copy variant sends with MSG_ZEROCOPY
+       and reaps the completions after every send. On loopback the kernel
+       still copies the data to the receiver, so it shows the overhead of the
+       completion notifications rather than the savings of a real NIC.
+     - bench-socket-*-connect: cost of connect() and accept() of a
+       connection, and of closing it, on a listening socket of the thread.  */
+
+#include "benchmark.h"
+
+#include <arpa/inet.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <vector>
+
+namespace {
+
+static constexpr size_t KB = 1024;
+
+/// Size of a send of the bulk benchmarks.
+static constexpr size_t bulk_size = 64 * KB;
+
+/// Receive timeout of servers (in ms), so that they notice the end of the
+/// measurement.
+static constexpr long recv_timeout_ms = 100;
+
+/// Busy-polling time of sockets with SO_BUSY_POLL (in us).
+static constexpr int busy_poll_us = 50;
+
+enum class Transport {
+  TCP,
+  UDP,
+  UNIX_STREAM,
+  UNIX_DGRAM,
+};
+
+static constexpr bool is_stream(Transport transport) {
+  return transport == Transport::TCP || transport == Transport::UNIX_STREAM;
+}
+
+/// Socket options of a benchmark.
+enum Options {
+  NONE = 0,
+  NODELAY = 1 << 0,
+  BUSY_POLL = 1 << 1,
+  ZEROCOPY = 1 << 2,
+};
+
+static bool set_option(int fd, int level, int name, int value) {
+  return ::setsockopt(fd, level, name, &value, sizeof(value)) == 0;
+}
+
+static void set_recv_timeout(int fd, long ms) {
+  struct timeval timeout = {0, ms * 1000};
+  if (::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
+    assert(0);
+  }
+}
+
+static struct sockaddr_in loopback_address() {
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  return addr;
+}
+
+static void local_address(int fd, struct sockaddr_in& addr) {
+  socklen_t len = sizeof(addr);
+  if (::getsockname(fd, reinterpret_cast<struct sockaddr *>(&addr), &len) < 0) {
+    assert(0);
+  }
+}
+
+/// Create a listening TCP socket on an ephemeral loopback port.
+static int tcp_listen(struct sockaddr_in& addr) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    assert(0);
+  }
+  addr = loopback_address();
+  if (::bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0 || ::listen(fd, 128) < 0) {
+    assert(0);
+  }
+  local_address(fd, addr);
+  return fd;
+}
+
+/// Create a listening AF_UNIX socket with a unique abstract address.
+static int unix_listen(struct sockaddr_un& addr, socklen_t& len) {
+  static std::atomic<unsigned> counter;
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    assert(0);
+  }
+  addr = {};
+  addr.sun_family = AF_UNIX;
+  int n = ::snprintf(addr.sun_path + 1, sizeof(addr.sun_path) - 1, "posixbench-%d-%u", ::getpid(), counter++);
+  len = offsetof(struct sockaddr_un, sun_path) + 1 + n;
+  if (::bind(fd, reinterpret_cast<struct sockaddr *>(&addr), len) < 0 || ::listen(fd, 128) < 0) {
+    assert(0);
+  }
+  return fd;
+}
+
+/// A connected pair of sockets.
+struct Connection {
+  int client = -1;
+  int server = -1;
+
+  explicit Connection(Transport transport) {
+    switch (transport) {
+      case Transport::TCP: {
+        struct sockaddr_in addr;
+        int listener = tcp_listen(addr);
+        client = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (client < 0 || ::connect(client, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0) {
+          assert(0);
+        }
+        server = ::accept(listener, nullptr, nullptr);
+        if (server < 0) {
+          assert(0);
+        }
+        ::close(listener);
+        break;
+      }
+      case Transport::UDP: {
+        client = ::socket(AF_INET, SOCK_DGRAM, 0);
+        server = ::socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in client_addr = loopback_address();
+        struct sockaddr_in server_addr = loopback_address();
+        if (client < 0 || server < 0 ||
+            ::bind(client, reinterpret_cast<struct sockaddr *>(&client_addr), sizeof(client_addr)) < 0 ||
+            ::bind(server, reinterpret_cast<struct sockaddr *>(&server_addr), sizeof(server_addr)) < 0) {
+          assert(0);
+        }
+        local_address(client, client_addr);
+        local_address(server, server_addr);
+        if (::connect(client, reinterpret_cast<struct sockaddr *>(&server_addr), sizeof(server_addr)) < 0 ||
+            ::connect(server, reinterpret_cast<struct sockaddr *>(&client_addr), sizeof(client_addr)) < 0) {
+          assert(0);
+        }
+        break;
+      }
+      case Transport::UNIX_STREAM:
+      case Transport::UNIX_DGRAM: {
+        int sv[2];
+        if (::socketpair(AF_UNIX, transport == Transport::UNIX_STREAM ? SOCK_STREAM : SOCK_DGRAM, 0, sv) < 0) {
+          assert(0);
+        }
+        client = sv[0];
+        server = sv[1];
+        break;
+      }
+    }
+    set_recv_timeout(server, recv_timeout_ms);
+  }
+
+  /// Set the socket @options. Return false if the kernel or the privileges
+  /// of the process do not allow an option.
+  bool configure(int options) {
+    for (int fd : {client, server}) {
+      if ((options & NODELAY) && !set_option(fd, IPPROTO_TCP, TCP_NODELAY, 1)) {
+        return false;
+      }
+      if ((options & BUSY_POLL) && !set_option(fd, SOL_SOCKET, SO_BUSY_POLL, busy_poll_us)) {
+        return false;
+      }
+    }
+    if ((options & ZEROCOPY) && !set_option(client, SOL_SOCKET, SO_ZEROCOPY, 1)) {
+      return false;
+    }
+    return true;
+  }
+
+  Connection(Connection&& other) noexcept : client{other.client}, server{other.server} {
+    other.client = other.server = -1;
+  }
+
+  ~Connection() {
+    if (client >= 0) {
+      ::close(client);
+    }
+    if (server >= 0) {
+      ::close(server);
+    }
+  }
+};
+
+/// Reap the MSG_ZEROCOPY completions of @fd that are available.
+static void reap_zerocopy_completions(int fd) {
+  char control[128];
+  for (;;) {
+    struct msghdr msg = {};
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (::recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+      if (errno == EAGAIN) {
+        return;
+      }
+      assert(0);
+    }
+  }
+}
+
+/// Send @size bytes, or one datagram.
+static void send_all(int fd, const char *buf, size_t size, int flags = 0) {
+  while (size > 0) {
+    ssize_t ret = ::send(fd, buf, size, flags | MSG_NOSIGNAL);
+    if (ret < 0) {
+      if (errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {
+        reap_zerocopy_completions(fd);
+        continue;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      assert(0);
+    }
+    buf += ret;
+    size -= ret;
+  }
+}
+
+/// Receive @size bytes from a stream socket, or one datagram. With
+/// @interruptible, give up and return false if the receive times out or is
+/// interrupted before any byte arrived, which servers do at the end of the
+/// measurement. Once a message has started, it is received in full so that
+/// the stream stays in sync.
+static bool recv_all(int fd, char *buf, size_t size, bool stream, bool interruptible) {
+  size_t done = 0;
+  do {
+    ssize_t ret = ::recv(fd, buf + done, size - done, 0);
+    if (ret < 0) {
+      if (interruptible && done == 0 && (errno == EAGAIN || errno == EINTR)) {
+        return false;
+      }
+      if (errno == EINTR || (interruptible && errno == EAGAIN)) {
+        continue;
+      }
+      assert(0);
+    }
+    if (ret == 0) {
+      return false;
+    }
+    done += ret;
+  } while (stream && done < size);
+  return true;
+}
+
+static size_t nr_remote_threads;
+
+/// Connections of the client with every server.
+template <Transport TRANSPORT, int OPTIONS>
+struct ConnectionAction {
+  std::vector<Connection> connections;
+  bool ok = true;
+  /// The running index of server to talk to.
+  size_t remote_idx = 0;
+
+  ConnectionAction() {
+    for (size_t i = 0; ok && i < nr_remote_threads; i++) {
+      connections.emplace_back(TRANSPORT);
+      ok = connections.back().configure(OPTIONS);
+    }
+  }
+
+  benchmark::NoState make_state(const benchmark::ThreadVector& ts) { return benchmark::NoState(ts); }
+
+  Connection& next_connection() {
+    Connection& conn = connections[remote_idx];
+    remote_idx = (remote_idx + 1) % connections.size();
+    return conn;
+  }
+
+  bool supported() { return ok; }
+
+  bool supports_non_interference() { return false; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+/// Round trip of a request of @SIZE bytes that the server echoes back.
+template <Transport TRANSPORT, size_t SIZE, int OPTIONS = NONE>
+struct RoundTripAction : ConnectionAction<TRANSPORT, OPTIONS> {
+  char request[SIZE] = {};
+  char response[SIZE];
+  std::vector<std::vector<char>> server_bufs{nr_remote_threads, std::vector<char>(SIZE)};
+
+  void raw_operation(benchmark::NoState& state) {
+    Connection& conn = this->next_connection();
+    send_all(conn.client, request, SIZE);
+    if (!recv_all(conn.client, response, SIZE, is_stream(TRANSPORT), false)) {
+      assert(0);
+    }
+  }
+
+  uint64_t measured_operation(benchmark::NoState& state) {
+    uint64_t start = benchmark::clock_start();
+    raw_operation(state);
+    uint64_t end = benchmark::clock_stop();
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(benchmark::NoState& state, size_t tid) {
+    Connection& conn = this->connections[tid];
+    char *buf = server_bufs[tid].data();
+    if (!recv_all(conn.server, buf, SIZE, is_stream(TRANSPORT), true)) {
+      return;
+    }
+    send_all(conn.server, buf, SIZE);
+  }
+};
+
+/// Send bulk_size bytes to a server that discards them.
+template <Transport TRANSPORT, int OPTIONS = NONE>
+struct BulkAction : ConnectionAction<TRANSPORT, OPTIONS> {
+  static_assert(is_stream(TRANSPORT));
+
+  std::vector<char> buf = std::vector<char>(bulk_size);
+  std::vector<std::vector<char>> server_bufs{nr_remote_threads, std::vector<char>(bulk_size)};
+
+  void raw_operation(benchmark::NoState& state) {
+    Connection& conn = this->next_connection();
+    if (OPTIONS & ZEROCOPY) {
+      send_all(conn.client, buf.data(), bulk_size, MSG_ZEROCOPY);
+      reap_zerocopy_completions(conn.client);
+    } else {
+      send_all(conn.client, buf.data(), bulk_size);
+    }
+  }
+
+  uint64_t measured_operation(benchmark::NoState& state) {
+    uint64_t start = benchmark::clock_start();
+    raw_operation(state);
+    uint64_t end = benchmark::clock_stop();
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(benchmark::NoState& state, size_t tid) {
+    if (::recv(this->connections[tid].server, server_bufs[tid].data(), bulk_size, 0) < 0) {
+      if (errno == EAGAIN || errno == EINTR) {
+        return;
+      }
+      assert(0);
+    }
+  }
+
+  size_t bytes_per_operation() { return bulk_size; }
+};
+
+struct ListenerState {
+  const benchmark::ThreadVector& interfering_threads;
+  Transport transport;
+  int listener;
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+
+  ListenerState(const benchmark::ThreadVector& interfering_threads, Transport transport)
+      : interfering_threads{interfering_threads}, transport{transport} {
+    if (transport == Transport::TCP) {
+      struct sockaddr_in *in = reinterpret_cast<struct sockaddr_in *>(&addr);
+      listener = tcp_listen(*in);
+      addr_len = sizeof(*in);
+    } else {
+      listener = unix_listen(*reinterpret_cast<struct sockaddr_un *>(&addr), addr_len);
+    }
+  }
+
+  ~ListenerState() {
+    ::close(listener);
+  }
+};
+
+/* Connect to and accept a connection on a listening socket of the thread,
+   and close both ends. The client resets the connection on close, so that
+   TCP connections do not linger in TIME_WAIT and use up the ephemeral
+   ports.  */
+template <Transport TRANSPORT>
+struct ConnectAction {
+  static_assert(TRANSPORT == Transport::TCP || TRANSPORT == Transport::UNIX_STREAM);
+
+  ListenerState make_state(const benchmark::ThreadVector& ts) { return ListenerState(ts, TRANSPORT); }
+
+  void raw_operation(ListenerState& state) {
+    int client = ::socket(TRANSPORT == Transport::TCP ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+    if (client < 0) {
+      assert(0);
+    }
+    if (::connect(client, reinterpret_cast<struct sockaddr *>(&state.addr), state.addr_len) < 0) {
+      assert(0);
+    }
+    int server = ::accept(state.listener, nullptr, nullptr);
+    if (server < 0) {
+      assert(0);
+    }
+    struct linger linger = {1, 0};
+    if (::setsockopt(client, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger)) < 0) {
+      assert(0);
+    }
+    ::close(client);
+    ::close(server);
+  }
+
+  uint64_t measured_operation(ListenerState& state) {
+    uint64_t start = benchmark::clock_start();
+    raw_operation(state);
+    uint64_t end = benchmark::clock_stop();
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(ListenerState& state, size_t tid) {
+    raw_operation(state);
+  }
+
+  bool supports_non_interference() { return true; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+static void init(size_t nr_threads) {
+  nr_remote_threads = nr_threads;
+}
+
+}  // namespace
+
+REGISTER_BENCHMARK((RoundTripAction<Transport::TCP, 64>), "bench-socket-tcp-rr-64b", init);
+REGISTER_BENCHMARK((RoundTripAction<Transport::TCP, 1 * KB>), "bench-socket-tcp-rr-1kb", init);
+REGISTER_BENCHMARK((RoundTripAction<Transport::TCP, 16 * KB>), "bench-socket-tcp-rr-16kb", init);
+REGISTER_BENCHMARK((RoundTripAction<Transport::TCP, 64 * KB>), "bench-socket-tcp-rr-64kb", init);
+REGISTER_BENCHMARK((RoundTripAction<Transport::TCP, 64, NODELAY>), "bench-socket-tcp-nodelay-rr-64b", init);
+REGISTER_BENCHMARK((RoundTripAction<Transport::TCP, 1 * KB, NODELAY>), "bench-socket-tcp-nodelay-rr-1kb", init);
+REGISTER_BENCHMARK((RoundTripAction<Transport::TCP, 16 * KB, NODELAY>), "bench-socket-tcp-nodelay-rr-16kb", init);
+REGISTER_BENCHMARK((RoundTripAction<Transport::TCP, 64 * KB, NODELAY>), "bench-socket-tcp-nodelay-rr-64kb", init);
+REGISTER_BENCHMARK((RoundTripAction<Transport::TCP, 64, NODELAY | BUSY_POLL>), "bench-socket-tcp-busy-poll-rr-64b", init);
+REGISTER_BENCHMARK((RoundTripAction<Transport::UDP, 64>), "bench-socket-udp-rr-64b", init);
+REGISTER_BENCHMARK((RoundTripAction<Transport::UDP, 1 * KB>), "bench-socket-udp-rr-1kb", init);
+REGISTER_BENCHMARK((RoundTripAction<Transport::UDP, 16 * KB>), "bench-socket-udp-rr-16kb", init);
+REGISTER_BENCHMARK((RoundTripAction<Transport::UDP, 64, BUSY_POLL>), "bench-socket-udp-busy-poll-rr-64b", init);
+REGISTER_BENCHMARK((RoundTripAction<Transport::UNIX_STREAM, 64>), "bench-socket-unix-stream-rr-64b", init);
+REGISTER_BENCHMARK((RoundTripAction<Transport::UNIX_STREAM, 1 * KB>), "bench-socket-unix-stream-rr-1kb", init);
+REGISTER_BENCHMARK((RoundTripAction<Transport::UNIX_STREAM, 16 * KB>), "bench-socket-unix-stream-rr-16kb", init);
+REGISTER_BENCHMARK((RoundTripAction<Transport::UNIX_STREAM, 64 * KB>), "bench-socket-unix-stream-rr-64kb", init);
+REGISTER_BENCHMARK((RoundTripAction<Transport::UNIX_DGRAM, 64>), "bench-socket-unix-dgram-rr-64b", init);
+REGISTER_BENCHMARK((RoundTripAction<Transport::UNIX_DGRAM, 1 * KB>), "bench-socket-unix-dgram-rr-1kb", init);
+REGISTER_BENCHMARK((RoundTripAction<Transport::UNIX_DGRAM, 16 * KB>), "bench-socket-unix-dgram-rr-16kb", init);
+REGISTER_BENCHMARK((BulkAction<Transport::TCP>), "bench-socket-tcp-bulk", init);
+REGISTER_BENCHMARK((BulkAction<Transport::TCP, ZEROCOPY>), "bench-socket-tcp-zerocopy-bulk", init);
+REGISTER_BENCHMARK((BulkAction<Transport::UNIX_STREAM>), "bench-socket-unix-stream-bulk", init);
+REGISTER_BENCHMARK(ConnectAction<Transport::TCP>, "bench-socket-tcp-connect");
+REGISTER_BENCHMARK(ConnectAction<Transport::UNIX_STREAM>, "bench-socket-unix-connect");
@@ -0,0 +1,410 @@
+/* Thread pool benchmarks.
+
+   These benchmarks hand tasks from the measuring thread to a pool whose
+   workers are the interfering threads, so the number of workers is set with
+   -n and their placement with -P and the interference scenario. The pools
+   differ in their task queue:
+
+     - mutex: a queue under a mutex, and a condition variable that idle
+       workers sleep on.
+     - ring: a bounded lock-free multi-producer multi-consumer ring.
+     - steal: a work-stealing pool, where every worker owns a Chase-Lev deque
+       that it pushes to and pops from, and steals from the other deques when
+       its own is empty. The measuring thread submits to a deque of its own.
+
+   Idle workers of the lock-free pools poll the queues for a while and then
+   sleep on a futex until a task is submitted.
+
+   The -start benchmarks measure the latency from submitting a task to a
+   worker starting it. The -fanout benchmarks submit a task that spawns
+   FANOUT - 1 more tasks from the worker that runs it, and measure until all
+   of them complete. They report the number of tasks completed per second
+   (tasks_per_sec), which is the cost that a pool amortizes instead of
+   creating a thread per task, see bench-pthread-create.  */
+
+#include "benchmark.h"
+#include "futex.hh"
+
+#include <deque>
+#include <memory>
+
+namespace {
+
+/// Upper bound of tasks in a queue.
+static constexpr size_t QUEUE_SIZE = 1024;
+
+/// Number of tasks that a -fanout operation completes.
+static constexpr size_t FANOUT = 64;
+
+/// Number of times an idle worker polls the queues before it sleeps.
+static constexpr int SPIN_LIMIT = 1024;
+
+/// How long an idle worker sleeps at most, so that it returns to the
+/// benchmark harness when a measurement ends.
+static constexpr long wait_timeout_ms = 100;
+
+struct Task {
+  enum Kind {
+    /// Record the time it starts at.
+    START,
+    /// Spawn FANOUT - 1 CHILD tasks.
+    ROOT,
+    CHILD,
+  } kind;
+};
+
+/* Put idle workers to sleep on a futex and wake them up when a task is
+   submitted, without system calls if no worker is sleeping.  */
+class Parker {
+  alignas(64) futex::Word _epoch{0};
+  alignas(64) std::atomic<uint32_t> _nr_sleepers{0};
+
+ public:
+  /// Wake up a sleeping worker after a task was pushed.
+  void notify() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_nr_sleepers.load(std::memory_order_relaxed) > 0) {
+      _epoch.fetch_add(1);
+      futex::wake(&_epoch, 1);
+    }
+  }
+
+  /// Return a task from @try_take, sleeping until notify() if there is none.
+  /// Return nullptr if there is still no task after waking up.
+  template <typename TryTake>
+  Task *park(TryTake try_take) {
+    uint32_t epoch = _epoch.load();
+    _nr_sleepers.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    Task *task = try_take();
+    if (!task) {
+      struct timespec timeout = {0, wait_timeout_ms * 1000000};
+      futex::wait(&_epoch, epoch, &timeout);
+      task = try_take();
+    }
+    _nr_sleepers.fetch_sub(1);
+    return task;
+  }
+};
+
+/// Poll @try_take up to SPIN_LIMIT times and then sleep in @parker.
+template <typename TryTake>
+static Task *spin_then_park(Parker& parker, TryTake try_take) {
+  for (int i = 0; i < SPIN_LIMIT; i++) {
+    if (Task *task = try_take()) {
+      return task;
+    }
+    benchmark::cpu_relax();
+  }
+  return parker.park(try_take);
+}
+
+/* Pools have a common interface. submit() is called by the measuring
+   thread, spawn() and take() by worker @tid, and take() returns nullptr if
+   no task arrived within a timeout.  */
+
+class MutexPool {
+  std::mutex _lock;
+  std::condition_variable _cond;
+  std::deque<Task *> _queue;
+
+  void push(Task *task) {
+    {
+      std::lock_guard<std::mutex> guard(_lock);
+      _queue.push_back(task);
+    }
+    _cond.notify_one();
+  }
+
+ public:
+  explicit MutexPool(size_t nr_workers) {}
+
+  void submit(Task *task) { push(task); }
+
+  void spawn(size_t tid, Task *task) { push(task); }
+
+  Task *take(size_t tid) {
+    std::unique_lock<std::mutex> guard(_lock);
+    if (!_cond.wait_for(guard, std::chrono::milliseconds(wait_timeout_ms), [this] { return !_queue.empty(); })) {
+      return nullptr;
+    }
+    Task *task = _queue.front();
+    _queue.pop_front();
+    return task;
+  }
+};
+
+/* Bounded multi-producer multi-consumer ring by Dmitry Vyukov. Every cell
+   has a sequence number that tells producers and consumers whose turn it is,
+   so they only contend on the enqueue and dequeue positions.  */
+class Ring {
+  struct alignas(64) Cell {
+    std::atomic<size_t> seq;
+    Task *task;
+  };
+
+  std::unique_ptr<Cell[]> _cells{new Cell[QUEUE_SIZE]};
+  alignas(64) std::atomic<size_t> _enqueue_pos{0};
+  alignas(64) std::atomic<size_t> _dequeue_pos{0};
+
+  static_assert((QUEUE_SIZE & (QUEUE_SIZE - 1)) == 0);
+
+ public:
+  Ring() {
+    for (size_t i = 0; i < QUEUE_SIZE; i++) {
+      _cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  void push(Task *task) {
+    size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell& cell = _cells[pos & (QUEUE_SIZE - 1)];
+      size_t seq = cell.seq.load(std::memory_order_acquire);
+      intptr_t diff = intptr_t(seq) - intptr_t(pos);
+      if (diff == 0) {
+        if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.task = task;
+          cell.seq.store(pos + 1, std::memory_order_release);
+          return;
+        }
+      } else if (diff < 0) {
+        /* The ring is full.  */
+        assert(0);
+      } else {
+        pos = _enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  Task *try_pop() {
+    size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell& cell = _cells[pos & (QUEUE_SIZE - 1)];
+      size_t seq = cell.seq.load(std::memory_order_acquire);
+      intptr_t diff = intptr_t(seq) - intptr_t(pos + 1);
+      if (diff == 0) {
+        if (_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          Task *task = cell.task;
+          cell.seq.store(pos + QUEUE_SIZE, std::memory_order_release);
+          return task;
+        }
+      } else if (diff < 0) {
+        return nullptr;
+      } else {
+        pos = _dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+};
+
+class RingPool {
+  Ring _ring;
+  Parker _parker;
+
+  void push(Task *task) {
+    _ring.push(task);
+    _parker.notify();
+  }
+
+ public:
+  explicit RingPool(size_t nr_workers) {}
+
+  void submit(Task *task) { push(task); }
+
+  void spawn(size_t tid, Task *task) { push(task); }
+
+  Task *take(size_t tid) {
+    return spin_then_park(_parker, [this] { return _ring.try_pop(); });
+  }
+};
+
+/* Fixed-size Chase-Lev work-stealing deque, with the memory orderings of
+   "Correct and Efficient Work-Stealing for Weak Memory Models" (Lê et al.,
+   PPoPP 2013). The owner pushes and pops at the bottom, other threads steal
+   from the top.  */
+class Deque {
+  std::unique_ptr<std::atomic<Task *>[]> _tasks{new std::atomic<Task *>[QUEUE_SIZE]};
+  alignas(64) std::atomic<int64_t> _top{0};
+  alignas(64) std::atomic<int64_t> _bottom{0};
+
+  std::atomic<Task *>& slot(int64_t idx) { return _tasks[idx & (QUEUE_SIZE - 1)]; }
+
+ public:
+  void push(Task *task) {
+    int64_t bottom = _bottom.load(std::memory_order_relaxed);
+    int64_t top = _top.load(std::memory_order_acquire);
+    if (bottom - top >= int64_t(QUEUE_SIZE)) {
+      assert(0);
+    }
+    slot(bottom).store(task, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _bottom.store(bottom + 1, std::memory_order_relaxed);
+  }
+
+  Task *pop() {
+    int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+    _bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = _top.load(std::memory_order_relaxed);
+    Task *task = nullptr;
+    if (top <= bottom) {
+      task = slot(bottom).load(std::memory_order_relaxed);
+      if (top == bottom) {
+        /* Last task, race against thieves.  */
+        if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+          task = nullptr;
+        }
+        _bottom.store(bottom + 1, std::memory_order_relaxed);
+      }
+    } else {
+      _bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return task;
+  }
+
+  Task *steal() {
+    int64_t top = _top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = _bottom.load(std::memory_order_acquire);
+    if (top >= bottom) {
+      return nullptr;
+    }
+    Task *task = slot(top).load(std::memory_order_relaxed);
+    if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return task;
+  }
+};
+
+class StealPool {
+  /// Deque N belongs to worker N, the last one to the measuring thread.
+  std::deque<Deque> _deques;
+  Parker _parker;
+
+  Task *try_take(size_t tid) {
+    if (Task *task = _deques[tid].pop()) {
+      return task;
+    }
+    for (size_t i = 1; i < _deques.size(); i++) {
+      if (Task *task = _deques[(tid + i) % _deques.size()].steal()) {
+        return task;
+      }
+    }
+    return nullptr;
+  }
+
+ public:
+  explicit StealPool(size_t nr_workers) : _deques(nr_workers + 1) {}
+
+  void submit(Task *task) {
+    _deques.back().push(task);
+    _parker.notify();
+  }
+
+  void spawn(size_t tid, Task *task) {
+    _deques[tid].push(task);
+    _parker.notify();
+  }
+
+  Task *take(size_t tid) {
+    return spin_then_park(_parker, [this, tid] { return try_take(tid); });
+  }
+};
+
+enum class Pattern {
+  START,
+  FANOUT,
+};
+
+template <typename Pool, Pattern PATTERN>
+struct Action {
+  static inline size_t nr_workers;
+
+  Pool pool{nr_workers};
+  Task start_task{Task::START};
+  Task root_task{Task::ROOT};
+  Task child_task{Task::CHILD};
+  /// Time the START task started at.
+  alignas(64) std::atomic<uint64_t> started{0};
+  /// Number of tasks of a ROOT task that have not completed.
+  alignas(64) std::atomic<size_t> remaining{0};
+
+  static void init(size_t nr_threads) { nr_workers = nr_threads; }
+
+  benchmark::NoState make_state(const benchmark::ThreadVector& ts) { return benchmark::NoState(ts); }
+
+  /// Run a task and return when it has started (START) or when it and the
+  /// tasks it spawned have completed (ROOT). Return the time of that.
+  uint64_t handoff() {
+    uint64_t end;
+    switch (PATTERN) {
+      case Pattern::START:
+        started.store(0, std::memory_order_relaxed);
+        pool.submit(&start_task);
+        while ((end = started.load(std::memory_order_acquire)) == 0) {
+          benchmark::cpu_relax();
+        }
+        break;
+      case Pattern::FANOUT:
+        remaining.store(FANOUT, std::memory_order_relaxed);
+        pool.submit(&root_task);
+        while (remaining.load(std::memory_order_acquire) != 0) {
+          benchmark::cpu_relax();
+        }
+        end = benchmark::clock_stop();
+        break;
+    }
+    return end;
+  }
+
+  void run(Task& task, size_t tid) {
+    switch (task.kind) {
+      case Task::START:
+        started.store(benchmark::clock_stop(), std::memory_order_release);
+        break;
+      case Task::ROOT:
+        for (size_t i = 1; i < FANOUT; i++) {
+          pool.spawn(tid, &child_task);
+        }
+        remaining.fetch_sub(1, std::memory_order_release);
+        break;
+      case Task::CHILD:
+        remaining.fetch_sub(1, std::memory_order_release);
+        break;
+    }
+  }
+
+  void raw_operation(benchmark::NoState& state) { handoff(); }
+
+  uint64_t measured_operation(benchmark::NoState& state) {
+    uint64_t start = benchmark::clock_start();
+    uint64_t end = handoff();
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(benchmark::NoState& state, size_t tid) {
+    if (Task *task = pool.take(tid)) {
+      run(*task, tid);
+    }
+  }
+
+  /* A -start operation returns before its task completes, so it does not
+     report a task throughput.  */
+  size_t tasks_per_operation() { return PATTERN == Pattern::FANOUT ? FANOUT : 0; }
+
+  bool supports_non_interference() { return false; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+}  // namespace
+
+#define REGISTER_POOL(pool, name)                                                                   \
+  REGISTER_BENCHMARK((Action<pool, Pattern::START>), name "-start", Action<pool, Pattern::START>::init); \
+  REGISTER_BENCHMARK((Action<pool, Pattern::FANOUT>), name "-fanout", Action<pool, Pattern::FANOUT>::init)
+
+REGISTER_POOL(MutexPool, "bench-pool-mutex");
+REGISTER_POOL(RingPool, "bench-pool-ring");
+REGISTER_POOL(StealPool, "bench-pool-steal");
@@ -0,0 +1,174 @@
+/* TLB shootdown benchmarks.
+
+   These benchmarks measure munmap(), mprotect() and madvise(MADV_DONTNEED)
+   of a region whose pages the interfering threads have just read, so the
+   kernel has to invalidate their TLB entries with inter-processor
+   interrupts. The number of interfering threads (-n), their placement (-P)
+   and the interference scenario give the number of CPUs to shoot down and
+   how far away they are.
+
+   Before every operation, the measuring thread asks the interfering threads
+   to read one byte of every page and waits until they all have. They then
+   busy-wait without touching the region, so their CPUs keep running the
+   process with the TLB entries cached. The region is restored and populated
+   again after every operation, outside of the measurement.
+
+   Regions are 4 KB pages without transparent huge pages. Linux flushes the
+   whole TLB instead of single pages above a threshold (33 pages by default,
+   see /sys/kernel/debug/x86/tlb_single_page_flush_ceiling), which the 256kb
+   and 2mb variants are above.  */
+
+#include "benchmark.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <memory>
+
+namespace {
+
+static constexpr size_t KB = 1024;
+static constexpr size_t MB = 1024 * KB;
+
+enum class Op {
+  MUNMAP,
+  MPROTECT,
+  DONTNEED,
+};
+
+template <Op OP, size_t SIZE>
+struct Action {
+  static inline size_t nr_helpers;
+
+  struct alignas(64) Ack {
+    std::atomic<uint64_t> generation{0};
+  };
+
+  size_t page_size = ::sysconf(_SC_PAGESIZE);
+  char *region = nullptr;
+  /// Incremented to ask the interfering threads to read the region.
+  alignas(64) std::atomic<uint64_t> generation{0};
+  std::unique_ptr<Ack[]> acks{new Ack[nr_helpers]};
+
+  static void init(size_t nr_threads) { nr_helpers = nr_threads; }
+
+  Action() {
+    void *map = ::mmap(nullptr, SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+      assert(0);
+    }
+    region = reinterpret_cast<char *>(map);
+    populate();
+  }
+
+  ~Action() { ::munmap(region, SIZE); }
+
+  void populate() {
+    ::madvise(region, SIZE, MADV_NOHUGEPAGE);
+    for (size_t offset = 0; offset < SIZE; offset += page_size) {
+      region[offset] = 1;
+    }
+  }
+
+  /// Undo the measured operation.
+  void restore() {
+    switch (OP) {
+      case Op::MUNMAP: {
+        /* Map the region at the same address unless another thread has
+           mapped something there in the meantime.  */
+        void *map = ::mmap(region, SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+        if (map == MAP_FAILED) {
+          map = ::mmap(nullptr, SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        }
+        if (map == MAP_FAILED) {
+          assert(0);
+        }
+        region = reinterpret_cast<char *>(map);
+        break;
+      }
+      case Op::MPROTECT:
+        if (::mprotect(region, SIZE, PROT_READ | PROT_WRITE) < 0) {
+          assert(0);
+        }
+        break;
+      case Op::DONTNEED:
+        break;
+    }
+    populate();
+  }
+
+  /// Wait until every interfering thread has read the region.
+  void warm_up_helpers() {
+    uint64_t gen = generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+    for (size_t tid = 0; tid < nr_helpers; tid++) {
+      while (acks[tid].generation.load(std::memory_order_acquire) != gen) {
+        benchmark::cpu_relax();
+      }
+    }
+  }
+
+  void operation() {
+    switch (OP) {
+      case Op::MUNMAP:
+        if (::munmap(region, SIZE) < 0) {
+          assert(0);
+        }
+        break;
+      case Op::MPROTECT:
+        if (::mprotect(region, SIZE, PROT_NONE) < 0) {
+          assert(0);
+        }
+        break;
+      case Op::DONTNEED:
+        if (::madvise(region, SIZE, MADV_DONTNEED) < 0) {
+          assert(0);
+        }
+        break;
+    }
+  }
+
+  benchmark::NoState make_state(const benchmark::ThreadVector& ts) { return benchmark::NoState(ts); }
+
+  void raw_operation(benchmark::NoState& state) {
+    warm_up_helpers();
+    operation();
+    restore();
+  }
+
+  uint64_t measured_operation(benchmark::NoState& state) {
+    warm_up_helpers();
+    uint64_t start = benchmark::clock_start();
+    operation();
+    uint64_t end = benchmark::clock_stop();
+    restore();
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(benchmark::NoState& state, size_t tid) {
+    uint64_t gen = generation.load(std::memory_order_acquire);
+    if (acks[tid].generation.load(std::memory_order_relaxed) == gen) {
+      benchmark::cpu_relax();
+      return;
+    }
+    for (size_t offset = 0; offset < SIZE; offset += page_size) {
+      (void)*static_cast<volatile char *>(region + offset);
+    }
+    acks[tid].generation.store(gen, std::memory_order_release);
+  }
+
+  bool supports_non_interference() { return false; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+}  // namespace
+
+#define REGISTER_SHOOTDOWN(op, name)                                                                      \
+  REGISTER_BENCHMARK((Action<op, 4 * KB>), name "-4kb", Action<op, 4 * KB>::init);                   \
+  REGISTER_BENCHMARK((Action<op, 64 * KB>), name "-64kb", Action<op, 64 * KB>::init);                \
+  REGISTER_BENCHMARK((Action<op, 256 * KB>), name "-256kb", Action<op, 256 * KB>::init);             \
+  REGISTER_BENCHMARK((Action<op, 2 * MB>), name "-2mb", Action<op, 2 * MB>::init)
+
+REGISTER_SHOOTDOWN(Op::MUNMAP, "bench-tlb-shootdown-munmap");
+REGISTER_SHOOTDOWN(Op::MPROTECT, "bench-tlb-shootdown-mprotect");
+REGISTER_SHOOTDOWN(Op::DONTNEED, "bench-tlb-shootdown-dontneed");
@@ -0,0 +1,327 @@
+/* User-space page fault handling benchmarks.
+
+   The bench-userfaultfd-* benchmarks measure the latency from a page fault
+   to the faulting thread resuming when the fault is handled in user space
+   with userfaultfd, as in lazy snapshot restore or post-copy migration. The
+   measuring thread faults on a page registered with userfaultfd and the
+   interfering threads handle the fault, so the interference scenario places
+   the handler relative to the faulting thread:
+
+     - copy: a missing fault on anonymous memory, handled with UFFDIO_COPY.
+     - zeropage: a missing fault on anonymous memory, handled with
+       UFFDIO_ZEROPAGE.
+     - continue: a minor fault on a page of a tmpfs file (a memfd) that is in
+       the page cache but not mapped, handled with UFFDIO_CONTINUE.
+     - wp: a write to a write-protected page of anonymous memory, handled by
+       removing the protection with UFFDIO_WRITEPROTECT.
+
+   The faults are reads, except for wp. The handler sleeps in read() on the
+   userfaultfd, or busy-polls it with O_NONBLOCK in the -spin variants.
+
+   bench-pagefault-signal-mprotect measures the traditional technique that
+   these compare with: a write to a PROT_NONE page raises SIGSEGV, and the
+   signal handler of the faulting thread removes the protection with
+   mprotect() so that the write is restarted. Unlike bench-pagefault-signal,
+   the measurement ends when the write completes.
+
+   Unprivileged processes can use userfaultfd with UFFD_USER_MODE_ONLY. The
+   benchmarks are skipped if the kernel does not support the feature they
+   need.  */
+
+#include "benchmark.h"
+#include "memory.hh"
+
+#include <fcntl.h>
+#include <linux/userfaultfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <memory>
+
+namespace {
+
+static constexpr size_t page_size = 4096;
+
+enum class Mode {
+  COPY,
+  ZEROPAGE,
+  CONTINUE,
+  WP,
+};
+
+template <Mode MODE, bool NONBLOCK>
+struct Action {
+  int uffd = -1;
+  int memfd = -1;
+  char *page = nullptr;
+  /// Contents that UFFDIO_COPY copies into the faulting page.
+  std::unique_ptr<char[]> source{new char[page_size]()};
+  bool ok = false;
+
+  Action() { ok = setup(); }
+
+  ~Action() {
+    if (page) {
+      ::munmap(page, page_size);
+    }
+    if (uffd >= 0) {
+      ::close(uffd);
+    }
+    if (memfd >= 0) {
+      ::close(memfd);
+    }
+  }
+
+  static uint64_t features() {
+    switch (MODE) {
+      case Mode::CONTINUE:
+        return UFFD_FEATURE_MINOR_SHMEM;
+      case Mode::WP:
+        return UFFD_FEATURE_PAGEFAULT_FLAG_WP;
+      default:
+        return 0;
+    }
+  }
+
+  static uint64_t register_mode() {
+    switch (MODE) {
+      case Mode::CONTINUE:
+        return UFFDIO_REGISTER_MODE_MINOR;
+      case Mode::WP:
+        return UFFDIO_REGISTER_MODE_WP;
+      default:
+        return UFFDIO_REGISTER_MODE_MISSING;
+    }
+  }
+
+  /// Map the page and register it. Return false if the kernel does not
+  /// support userfaultfd or MODE.
+  bool setup() {
+    uffd = ::syscall(SYS_userfaultfd, O_CLOEXEC | UFFD_USER_MODE_ONLY | (NONBLOCK ? O_NONBLOCK : 0));
+    if (uffd < 0) {
+      return false;
+    }
+    struct uffdio_api api = {};
+    api.api = UFFD_API;
+    api.features = features();
+    if (::ioctl(uffd, UFFDIO_API, &api) < 0) {
+      return false;
+    }
+    void *map;
+    if (MODE == Mode::CONTINUE) {
+      memfd = ::memfd_create("posixbench", MFD_CLOEXEC);
+      if (memfd < 0 || ::ftruncate(memfd, page_size) < 0 || ::fallocate(memfd, 0, 0, page_size) < 0) {
+        return false;
+      }
+      map = ::mmap(nullptr, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    } else {
+      map = ::mmap(nullptr, page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (map == MAP_FAILED) {
+      assert(0);
+    }
+    page = reinterpret_cast<char *>(map);
+    if (MODE == Mode::WP) {
+      memory::force_write(page, char(1));
+    }
+    struct uffdio_register reg = {};
+    reg.range.start = reinterpret_cast<uintptr_t>(page);
+    reg.range.len = page_size;
+    reg.mode = register_mode();
+    if (::ioctl(uffd, UFFDIO_REGISTER, &reg) < 0) {
+      return false;
+    }
+    reset();
+    return true;
+  }
+
+  /// Put the page into the state that the fault starts from.
+  void reset() {
+    if (MODE == Mode::WP) {
+      write_protect(reinterpret_cast<uintptr_t>(page), UFFDIO_WRITEPROTECT_MODE_WP);
+      return;
+    }
+    /* Zap the page table entry. The page of a memfd stays in the page
+       cache.  */
+    if (::madvise(page, page_size, MADV_DONTNEED) < 0) {
+      assert(0);
+    }
+  }
+
+  void write_protect(uintptr_t addr, uint64_t mode) {
+    struct uffdio_writeprotect wp = {};
+    wp.range.start = addr;
+    wp.range.len = page_size;
+    wp.mode = mode;
+    if (::ioctl(uffd, UFFDIO_WRITEPROTECT, &wp) < 0) {
+      assert(0);
+    }
+  }
+
+  void fault() {
+    if (MODE == Mode::WP) {
+      memory::force_write(page, char(1));
+    } else {
+      memory::force_read(page);
+    }
+  }
+
+  /// Resolve the fault at @addr and wake up the faulting thread.
+  void resolve(uintptr_t addr) {
+    int err = 0;
+    switch (MODE) {
+      case Mode::COPY: {
+        struct uffdio_copy copy = {};
+        copy.dst = addr;
+        copy.src = reinterpret_cast<uintptr_t>(source.get());
+        copy.len = page_size;
+        err = ::ioctl(uffd, UFFDIO_COPY, &copy);
+        break;
+      }
+      case Mode::ZEROPAGE: {
+        struct uffdio_zeropage zeropage = {};
+        zeropage.range.start = addr;
+        zeropage.range.len = page_size;
+        err = ::ioctl(uffd, UFFDIO_ZEROPAGE, &zeropage);
+        break;
+      }
+      case Mode::CONTINUE: {
+        struct uffdio_continue cont = {};
+        cont.range.start = addr;
+        cont.range.len = page_size;
+        err = ::ioctl(uffd, UFFDIO_CONTINUE, &cont);
+        break;
+      }
+      case Mode::WP:
+        write_protect(addr, 0);
+        break;
+    }
+    if (err < 0) {
+      if (errno != EEXIST) {
+        assert(0);
+      }
+      /* The page was mapped by a spurious fault in the meantime.  */
+      struct uffdio_range range = {addr, page_size};
+      ::ioctl(uffd, UFFDIO_WAKE, &range);
+    }
+  }
+
+  benchmark::NoState make_state(const benchmark::ThreadVector& ts) { return benchmark::NoState(ts); }
+
+  void raw_operation(benchmark::NoState& state) {
+    fault();
+    reset();
+  }
+
+  uint64_t measured_operation(benchmark::NoState& state) {
+    uint64_t start = benchmark::clock_start();
+    fault();
+    uint64_t end = benchmark::clock_stop();
+    reset();
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  /* Every interfering thread is a fault handler.  */
+  void other_operation(benchmark::NoState& state, size_t tid) {
+    struct uffd_msg msg;
+    if (::read(uffd, &msg, sizeof(msg)) != sizeof(msg)) {
+      if (errno == EAGAIN) {
+        benchmark::cpu_relax();
+        return;
+      }
+      if (errno == EINTR) {
+        return;
+      }
+      assert(0);
+    }
+    if (msg.event != UFFD_EVENT_PAGEFAULT) {
+      return;
+    }
+    resolve(msg.arg.pagefault.address & ~uint64_t(page_size - 1));
+  }
+
+  bool supported() { return ok; }
+
+  bool supports_non_interference() { return false; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+static void sigaction_segv(int signal, siginfo_t *si, void *arg) {
+  void *page = reinterpret_cast<void *>(reinterpret_cast<uintptr_t>(si->si_addr) & ~(page_size - 1));
+  if (::mprotect(page, page_size, PROT_READ | PROT_WRITE) < 0) {
+    /* Not a fault of the benchmark, let it crash.  */
+    ::signal(SIGSEGV, SIG_DFL);
+  }
+}
+
+/* Every thread faults on a page of its own.  */
+struct SignalMprotectAction {
+  struct State {
+    const benchmark::ThreadVector& interfering_threads;
+    char *page = nullptr;
+
+    State(const benchmark::ThreadVector& interfering_threads) : interfering_threads{interfering_threads} {
+      void *map = ::mmap(nullptr, page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (map == MAP_FAILED) {
+        assert(0);
+      }
+      page = reinterpret_cast<char *>(map);
+      memory::force_write(page, char(1));
+      reset();
+    }
+
+    void reset() {
+      if (::mprotect(page, page_size, PROT_NONE) < 0) {
+        assert(0);
+      }
+    }
+  };
+
+  ~SignalMprotectAction() { ::signal(SIGSEGV, SIG_DFL); }
+
+  State make_state(const benchmark::ThreadVector& ts) {
+    struct ::sigaction sa;
+    sa.sa_sigaction = sigaction_segv;
+    sa.sa_flags = SA_SIGINFO;
+    ::sigemptyset(&sa.sa_mask);
+    ::sigaction(SIGSEGV, &sa, nullptr);
+    return State(ts);
+  }
+
+  void raw_operation(State& state) {
+    memory::force_write(state.page, char(1));
+    state.reset();
+  }
+
+  uint64_t measured_operation(State& state) {
+    uint64_t start = benchmark::clock_start();
+    memory::force_write(state.page, char(1));
+    uint64_t end = benchmark::clock_stop();
+    state.reset();
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(State& state, size_t tid) {
+    raw_operation(state);
+  }
+
+  bool supports_non_interference() { return true; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+}  // namespace
+
+#define REGISTER_USERFAULTFD(mode, name)                          \
+  REGISTER_BENCHMARK((Action<mode, false>), name);                \
+  REGISTER_BENCHMARK((Action<mode, true>), name "-spin")
+
+REGISTER_USERFAULTFD(Mode::COPY, "bench-userfaultfd-copy");
+REGISTER_USERFAULTFD(Mode::ZEROPAGE, "bench-userfaultfd-zeropage");
+REGISTER_USERFAULTFD(Mode::CONTINUE, "bench-userfaultfd-continue");
+REGISTER_USERFAULTFD(Mode::WP, "bench-userfaultfd-wp");
+
+REGISTER_BENCHMARK(SignalMprotectAction, "bench-pagefault-signal-mprotect");
@@ -0,0 +1,302 @@
+/* Zero-copy data movement benchmarks.
+
+   These benchmarks compare moving data with read() and write() through a
+   user space buffer against the system calls that avoid the copy: splice(),
+   vmsplice(), sendfile() and copy_file_range(). Data moves between files in
+   the work directory (-w, point it to tmpfs to take the disk out of the
+   picture), pipes and AF_UNIX sockets.
+
+   Every thread has its own source file, destination file, pipe and socket
+   pair. Pipes and sockets are drained by the same thread after every chunk,
+   so transfers larger than chunk_size are split into several chunks. Pipes
+   are drained with a splice() to /dev/null in all variants, so that the
+   variants differ only in how data enters the pipe.  */
+
+#include "benchmark.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace {
+
+static constexpr size_t KB = 1024;
+static constexpr size_t MB = 1024 * KB;
+
+/// Largest transfer size, which is also the size of the files and buffers.
+static constexpr size_t max_size = 1 * MB;
+
+/// Largest amount of data in a pipe or socket at a time.
+static constexpr size_t chunk_size = 64 * KB;
+
+struct State {
+  const benchmark::ThreadVector& interfering_threads;
+  std::string src_path;
+  std::string dst_path;
+  int src;
+  int dst;
+  int pipe[2];
+  int sock[2];
+  int devnull;
+  char *buf;
+  char *recv_buf;
+
+  State(const benchmark::ThreadVector& interfering_threads)
+      : interfering_threads{interfering_threads} {
+    buf = static_cast<char *>(::aligned_alloc(4 * KB, max_size));
+    recv_buf = static_cast<char *>(::aligned_alloc(4 * KB, max_size));
+    if (!buf || !recv_buf) {
+      assert(0);
+    }
+    ::memset(buf, 0xaa, max_size);
+    ::memset(recv_buf, 0, max_size);
+    src = benchmark::create_work_file("tmp-bench-zero-copy", src_path);
+    if (src < 0) {
+      assert(0);
+    }
+    if (::pwrite(src, buf, max_size, 0) != ssize_t(max_size)) {
+      assert(0);
+    }
+    dst = benchmark::create_work_file("tmp-bench-zero-copy", dst_path);
+    if (dst < 0) {
+      assert(0);
+    }
+    if (::pipe(pipe) < 0) {
+      assert(0);
+    }
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, sock) < 0) {
+      assert(0);
+    }
+    devnull = ::open("/dev/null", O_WRONLY);
+    if (devnull < 0) {
+      assert(0);
+    }
+  }
+
+  ~State() {
+    ::close(devnull);
+    ::close(sock[0]);
+    ::close(sock[1]);
+    ::close(pipe[0]);
+    ::close(pipe[1]);
+    ::close(dst);
+    ::unlink(dst_path.c_str());
+    ::close(src);
+    ::unlink(src_path.c_str());
+    ::free(recv_buf);
+    ::free(buf);
+  }
+
+  /// Discard @size bytes from the pipe.
+  void drain_pipe(size_t size) {
+    while (size > 0) {
+      ssize_t ret = ::splice(pipe[0], nullptr, devnull, nullptr, size, SPLICE_F_MOVE);
+      if (ret <= 0) {
+        assert(0);
+      }
+      size -= ret;
+    }
+  }
+
+  /// Receive @size bytes from the socket pair.
+  void drain_socket(size_t size) {
+    char *p = recv_buf;
+    while (size > 0) {
+      ssize_t ret = ::read(sock[1], p, size);
+      if (ret <= 0) {
+        assert(0);
+      }
+      p += ret;
+      size -= ret;
+    }
+  }
+};
+
+/// Return true if @ret is a complete transfer of @size bytes.
+static bool complete(ssize_t ret, size_t size) {
+  return ret == ssize_t(size);
+}
+
+/// Copy a file to another file with pread() and pwrite().
+struct FileReadWrite {
+  static void transfer(State& state, size_t size) {
+    if (!complete(::pread(state.src, state.buf, size, 0), size)) {
+      assert(0);
+    }
+    if (!complete(::pwrite(state.dst, state.buf, size, 0), size)) {
+      assert(0);
+    }
+  }
+};
+
+/// Copy a file to another file with copy_file_range().
+struct FileCopyFileRange {
+  static void transfer(State& state, size_t size) {
+    loff_t off_in = 0;
+    loff_t off_out = 0;
+    while (size > 0) {
+      ssize_t ret = ::copy_file_range(state.src, &off_in, state.dst, &off_out, size, 0);
+      if (ret <= 0) {
+        assert(0);
+      }
+      size -= ret;
+    }
+  }
+};
+
+/// Copy a file to another file with sendfile().
+struct FileSendfile {
+  static void transfer(State& state, size_t size) {
+    if (::lseek(state.dst, 0, SEEK_SET) < 0) {
+      assert(0);
+    }
+    off_t offset = 0;
+    while (size > 0) {
+      ssize_t ret = ::sendfile(state.dst, state.src, &offset, size);
+      if (ret <= 0) {
+        assert(0);
+      }
+      size -= ret;
+    }
+  }
+};
+
+/// Move a file through a pipe with pread() and write().
+struct PipeReadWrite {
+  static void transfer(State& state, size_t size) {
+    for (size_t off = 0; off < size; off += chunk_size) {
+      size_t len = std::min(chunk_size, size - off);
+      if (!complete(::pread(state.src, state.buf, len, off), len)) {
+        assert(0);
+      }
+      if (!complete(::write(state.pipe[1], state.buf, len), len)) {
+        assert(0);
+      }
+      state.drain_pipe(len);
+    }
+  }
+};
+
+/// Move a file through a pipe with splice().
+struct PipeSplice {
+  static void transfer(State& state, size_t size) {
+    for (size_t off = 0; off < size; off += chunk_size) {
+      size_t len = std::min(chunk_size, size - off);
+      loff_t offset = off;
+      if (!complete(::splice(state.src, &offset, state.pipe[1], nullptr, len, SPLICE_F_MOVE), len)) {
+        assert(0);
+      }
+      state.drain_pipe(len);
+    }
+  }
+};
+
+/// Move memory through a pipe with write().
+struct PipeWrite {
+  static void transfer(State& state, size_t size) {
+    for (size_t off = 0; off < size; off += chunk_size) {
+      size_t len = std::min(chunk_size, size - off);
+      if (!complete(::write(state.pipe[1], state.buf + off, len), len)) {
+        assert(0);
+      }
+      state.drain_pipe(len);
+    }
+  }
+};
+
+/* Move memory through a pipe with vmsplice(). The pipe references the pages
+   of the buffer, which is safe because the pipe is drained before the buffer
+   can change.  */
+struct PipeVmsplice {
+  static void transfer(State& state, size_t size) {
+    for (size_t off = 0; off < size; off += chunk_size) {
+      size_t len = std::min(chunk_size, size - off);
+      struct iovec iov = {state.buf + off, len};
+      if (!complete(::vmsplice(state.pipe[1], &iov, 1, 0), len)) {
+        assert(0);
+      }
+      state.drain_pipe(len);
+    }
+  }
+};
+
+/// Send a file over an AF_UNIX socket with pread() and write().
+struct UnixReadWrite {
+  static void transfer(State& state, size_t size) {
+    for (size_t off = 0; off < size; off += chunk_size) {
+      size_t len = std::min(chunk_size, size - off);
+      if (!complete(::pread(state.src, state.buf, len, off), len)) {
+        assert(0);
+      }
+      if (!complete(::write(state.sock[0], state.buf, len), len)) {
+        assert(0);
+      }
+      state.drain_socket(len);
+    }
+  }
+};
+
+/// Send a file over an AF_UNIX socket with sendfile().
+struct UnixSendfile {
+  static void transfer(State& state, size_t size) {
+    for (size_t off = 0; off < size; off += chunk_size) {
+      size_t len = std::min(chunk_size, size - off);
+      off_t offset = off;
+      if (!complete(::sendfile(state.sock[0], state.src, &offset, len), len)) {
+        assert(0);
+      }
+      state.drain_socket(len);
+    }
+  }
+};
+
+/// Move @SIZE bytes with the @Method transfer.
+template <typename Method, size_t SIZE>
+struct Action {
+  static_assert(SIZE <= max_size);
+
+  State make_state(const benchmark::ThreadVector& ts) { return State(ts); }
+
+  void raw_operation(State& state) {
+    Method::transfer(state, SIZE);
+  }
+
+  uint64_t measured_operation(State& state) {
+    uint64_t start = benchmark::clock_start();
+    Method::transfer(state, SIZE);
+    uint64_t end = benchmark::clock_stop();
+    return benchmark::clock_elapsed(start, end);
+  }
+
+  void other_operation(State& state, size_t tid) {
+    raw_operation(state);
+  }
+
+  size_t bytes_per_operation() { return SIZE; }
+
+  bool supports_non_interference() { return true; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
+}  // namespace
+
+#define REGISTER_ZERO_COPY(method, name)                              \
+  REGISTER_BENCHMARK((Action<method, 4 * KB>), name "-4kb");          \
+  REGISTER_BENCHMARK((Action<method, 64 * KB>), name "-64kb");        \
+  REGISTER_BENCHMARK((Action<method, 1 * MB>), name "-1mb")
+
+REGISTER_ZERO_COPY(FileReadWrite, "bench-zero-copy-file-read-write");
+REGISTER_ZERO_COPY(FileCopyFileRange, "bench-zero-copy-file-copy-file-range");
+REGISTER_ZERO_COPY(FileSendfile, "bench-zero-copy-file-sendfile");
+REGISTER_ZERO_COPY(PipeReadWrite, "bench-zero-copy-pipe-read-write");
+REGISTER_ZERO_COPY(PipeSplice, "bench-zero-copy-pipe-splice");
+REGISTER_ZERO_COPY(PipeWrite, "bench-zero-copy-pipe-write");
+REGISTER_ZERO_COPY(PipeVmsplice, "bench-zero-copy-pipe-vmsplice");
+REGISTER_ZERO_COPY(UnixReadWrite, "bench-zero-copy-unix-read-write");
+REGISTER_ZERO_COPY(UnixSendfile, "bench-zero-copy-unix-sendfile");
@@ -1,33 +1,52 @@
 #pragma once
 
+#include <ctype.h>
 #include <fcntl.h>
+#include <fnmatch.h>
 #include <libgen.h>
 #include <math.h>
 #include <pthread.h>
 #include <signal.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/utsname.h>
 #include <time.h>
+#include <unistd.h>
 
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
 #include <array>
 #include <atomic>
+#include <chrono>
 #include <cassert>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <random>
 #include <system_error>
 #include <thread>
+#include <type_traits>
 #include <vector>
 
 #include <hdr_histogram.h>
+#include <hdr_histogram_log.h>
 #include <hdr_interval_recorder.h>
 #include <hwloc.h>
 
 namespace benchmark {
 
 static uint64_t timespec_to_ns(struct timespec *ts) {
-  return ts->tv_sec * 1e9 + ts->tv_nsec;
+  return ts->tv_sec * UINT64_C(1000000000) + ts->tv_nsec;
 }
 
 static uint64_t time_diff(struct timespec *start, struct timespec *end) {
@@ -37,6 +56,162 @@ static uint64_t time_diff(struct timespec *start, struct timespec *end) {
   return end_ns - start_ns;
 }
 
+/// Clock policy backed by clock_gettime(CLOCK_MONOTONIC). One tick is one
+/// nanosecond.
+struct MonotonicClock {
+  static uint64_t now() {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
+      assert(0);
+    }
+    return timespec_to_ns(&ts);
+  }
+
+  static uint64_t start() { return now(); }
+
+  static uint64_t stop() { return now(); }
+};
+
+#if defined(__x86_64__)
+#define HAVE_CYCLE_CLOCK 1
+/// Clock policy backed by the time-stamp counter. The LFENCE before RDTSC
+/// waits for earlier instructions to complete, RDTSCP waits for the measured
+/// code to complete, and the trailing LFENCEs keep later instructions from
+/// starting before the counter is read.
+struct CycleClock {
+  static uint64_t start() {
+    uint32_t lo, hi;
+    asm volatile("lfence\n\trdtsc\n\tlfence" : "=a"(lo), "=d"(hi) : : "memory");
+    return (uint64_t(hi) << 32) | lo;
+  }
+
+  static uint64_t stop() {
+    uint32_t lo, hi, aux;
+    asm volatile("rdtscp\n\tlfence" : "=a"(lo), "=d"(hi), "=c"(aux) : : "memory");
+    return (uint64_t(hi) << 32) | lo;
+  }
+};
+#elif defined(__aarch64__)
+#define HAVE_CYCLE_CLOCK 1
+/// Clock policy backed by the generic timer's virtual count register. The
+/// ISBs keep the counter read from being reordered with the measured code.
+struct CycleClock {
+  static uint64_t start() {
+    uint64_t ticks;
+    asm volatile("isb\n\tmrs %0, cntvct_el0\n\tisb" : "=r"(ticks) : : "memory");
+    return ticks;
+  }
+
+  static uint64_t stop() { return start(); }
+};
+#endif
+
+/// Tell the CPU that the calling thread is busy-waiting.
+inline void cpu_relax() {
+#if defined(__x86_64__)
+  asm volatile("pause" ::: "memory");
+#elif defined(__aarch64__)
+  asm volatile("yield" ::: "memory");
+#endif
+}
+
+enum class ClockSource {
+  /// clock_gettime(CLOCK_MONOTONIC).
+  MONOTONIC,
+  /// CPU cycle counter (TSC on x86-64, CNTVCT_EL0 on AArch64).
+  CYCLE,
+};
+
+/// Clock used for latency measurements.
+inline ClockSource clock_source = ClockSource::MONOTONIC;
+
+/// Nanoseconds per clock tick as a 32.32 fixed-point number.
+inline uint64_t clock_ns_per_tick = UINT64_C(1) << 32;
+
+/// Read the clock at the beginning of a measured interval (in ticks).
+inline uint64_t clock_start() {
+#ifdef HAVE_CYCLE_CLOCK
+  if (clock_source == ClockSource::CYCLE) {
+    return CycleClock::start();
+  }
+#endif
+  return MonotonicClock::start();
+}
+
+/// Read the clock at the end of a measured interval (in ticks).
+inline uint64_t clock_stop() {
+#ifdef HAVE_CYCLE_CLOCK
+  if (clock_source == ClockSource::CYCLE) {
+    return CycleClock::stop();
+  }
+#endif
+  return MonotonicClock::stop();
+}
+
+inline uint64_t clock_ticks_to_ns(uint64_t ticks) {
+  return (static_cast<unsigned __int128>(ticks) * clock_ns_per_tick) >> 32;
+}
+
+/// Nanoseconds elapsed between two clock readings.
+inline uint64_t clock_elapsed(uint64_t start, uint64_t end) {
+  assert(start <= end);
+  return clock_ticks_to_ns(end - start);
+}
+
+/// Clock source that clock_ns_per_tick was calibrated for.
+inline std::optional<ClockSource> clock_calibrated_source;
+
+/// Calibrate the clock against CLOCK_MONOTONIC by spinning for @duration_ns
+/// and comparing how far both clocks advanced. The calibration is done once
+/// per clock source, so running several benchmarks spins only once.
+inline void clock_calibrate(uint64_t duration_ns = 100000000) {
+  if (clock_calibrated_source == clock_source) {
+    return;
+  }
+  clock_calibrated_source = clock_source;
+  clock_ns_per_tick = UINT64_C(1) << 32;
+  if (clock_source == ClockSource::MONOTONIC) {
+    return;
+  }
+  uint64_t ns_begin = MonotonicClock::now();
+  uint64_t ticks_begin = clock_start();
+  uint64_t ns_end;
+  do {
+    ns_end = MonotonicClock::now();
+  } while (ns_end - ns_begin < duration_ns);
+  uint64_t ticks_end = clock_stop();
+  clock_ns_per_tick = (static_cast<unsigned __int128>(ns_end - ns_begin) << 32) / (ticks_end - ticks_begin);
+}
+
+/// Measure the self-overhead of the clock, which is the shortest interval
+/// between back-to-back clock_start() and clock_stop() calls (in ns). The
+/// minimum is used so that subtracting it never removes time spent in the
+/// measured operation.
+inline uint64_t clock_overhead(size_t nr_iterations = 100000) {
+  uint64_t overhead = UINT64_MAX;
+  for (size_t i = 0; i < nr_iterations; i++) {
+    uint64_t start = clock_start();
+    uint64_t end = clock_stop();
+    overhead = std::min(overhead, clock_elapsed(start, end));
+  }
+  return overhead;
+}
+
+static ClockSource parse_clock_source(const std::string& raw_clock)
+{
+  if (raw_clock == "monotonic") {
+    return ClockSource::MONOTONIC;
+  } else if (raw_clock == "cycle") {
+#ifdef HAVE_CYCLE_CLOCK
+    return ClockSource::CYCLE;
+#else
+    throw std::invalid_argument("cycle clock is not supported on this architecture");
+#endif
+  } else {
+    throw std::invalid_argument("unknown '" + raw_clock + "' clock option");
+  }
+}
+
 enum class Interference : uint8_t {
   NONE = 0x01,
   LOCAL_CORE = 0x02,
@@ -86,6 +261,66 @@ struct NoState {
   {}
 };
 
+/// Directory in which benchmarks create their files.
+inline std::string work_dir = ".";
+
+/// Create a uniquely named file in work_dir and return its descriptor. The
+/// path of the file is stored in @path.
+inline int create_work_file(const std::string& prefix, std::string& path, int flags = 0) {
+  path = work_dir + "/" + prefix + "XXXXXX";
+  return ::mkostemp(path.data(), flags);
+}
+
+/* Optional Action members. An Action that defines supported() is skipped
+   when it returns false, for example when the kernel or the filesystem
+   lacks a feature. An Action that defines bytes_per_operation() also
+   reports its throughput, and an Action that defines tasks_per_operation()
+   reports the number of tasks that it completes per second.  */
+template <typename Action, typename = void>
+struct has_supported : std::false_type {};
+
+template <typename Action>
+struct has_supported<Action, std::void_t<decltype(std::declval<Action&>().supported())>> : std::true_type {};
+
+template <typename Action, typename = void>
+struct has_bytes_per_operation : std::false_type {};
+
+template <typename Action>
+struct has_bytes_per_operation<Action, std::void_t<decltype(std::declval<Action&>().bytes_per_operation())>> : std::true_type {};
+
+template <typename Action, typename = void>
+struct has_tasks_per_operation : std::false_type {};
+
+template <typename Action>
+struct has_tasks_per_operation<Action, std::void_t<decltype(std::declval<Action&>().tasks_per_operation())>> : std::true_type {};
+
+template <typename Action>
+inline bool is_supported(Action& action, const std::string& benchmark) {
+  if constexpr (has_supported<Action>::value) {
+    if (!action.supported()) {
+      std::cerr << "warning: " << benchmark << " is not supported on this system" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename Action>
+inline size_t bytes_per_operation(Action& action) {
+  if constexpr (has_bytes_per_operation<Action>::value) {
+    return action.bytes_per_operation();
+  }
+  return 0;
+}
+
+template <typename Action>
+inline size_t tasks_per_operation(Action& action) {
+  if constexpr (has_tasks_per_operation<Action>::value) {
+    return action.tasks_per_operation();
+  }
+  return 0;
+}
+
 template <typename Operation, typename State = NoState>
 struct SymmetricAction {
   State make_state(const ThreadVector& interfering_threads) { return State(interfering_threads); }
@@ -93,16 +328,10 @@ struct SymmetricAction {
   void raw_operation(State& state) { Operation()(state); }
 
   uint64_t measured_operation(State& state) {
-    struct timespec start;
-    if (clock_gettime(CLOCK_MONOTONIC, &start) < 0) {
-      assert(0);
-    }
+    uint64_t start = clock_start();
     raw_operation(state);
-    struct timespec end;
-    if (clock_gettime(CLOCK_MONOTONIC, &end) < 0) {
-      assert(0);
-    }
-    return time_diff(&start, &end);
+    uint64_t end = clock_stop();
+    return clock_elapsed(start, end);
   }
 
   void other_operation(State& state, size_t tid) { raw_operation(state); }
@@ -112,8 +341,128 @@ struct SymmetricAction {
   bool supports_energy_measurement() { return true; }
 };
 
+/* Measure the wakeup delay of a cross-thread notification mechanism. The
+   measuring thread notifies one interfering thread at a time, round-robin,
+   and waits for a notification back. The interfering thread takes the end
+   timestamp as soon as it wakes up, so the measurement is the one-way wakeup
+   delay and not the full round trip.
+
+   The Notifier policy implements the mechanism with the following members:
+
+     Notifier(size_t nr_remote_threads);
+     void notify_remote(const ThreadVector& ts, size_t tid);
+     bool wait_remote(size_t tid);
+     void notify_local(size_t tid);
+     void wait_local(size_t tid);
+
+   notify_remote() and wait_local() run on the measuring thread, wait_remote()
+   and notify_local() on interfering thread @tid. wait_remote() returns false
+   if it returns without a notification, for example when it is interrupted
+   by the benchmark harness or when a busy-polling notifier finds nothing. A
+   Notifier may also define supported().
+
+   The number of interfering threads must be passed to init() before the
+   Action is created, so PingPongAction::init is the init function of the
+   registration.  */
+template <typename Notifier>
+struct PingPongAction {
+  static inline size_t nr_remote_threads;
+
+  struct alignas(64) Timestamp {
+    uint64_t value = 0;
+  };
+
+  Notifier notifier{nr_remote_threads};
+  std::unique_ptr<Timestamp[]> timestamps{new Timestamp[nr_remote_threads]};
+  /// The running index of remote thread to wake up.
+  size_t remote_idx = 0;
+
+  static void init(size_t nr_threads) { nr_remote_threads = nr_threads; }
+
+  NoState make_state(const ThreadVector& ts) { return NoState(ts); }
+
+  uint64_t ping_pong(NoState& state) {
+    size_t idx = remote_idx;
+    remote_idx = (remote_idx + 1) % nr_remote_threads;
+    notifier.notify_remote(state.interfering_threads, idx);
+    notifier.wait_local(idx);
+    return timestamps[idx].value;
+  }
+
+  void raw_operation(NoState& state) { ping_pong(state); }
+
+  uint64_t measured_operation(NoState& state) {
+    uint64_t start = clock_start();
+    uint64_t end = ping_pong(state);
+    return clock_elapsed(start, end);
+  }
+
+  void other_operation(NoState& state, size_t tid) {
+    if (!notifier.wait_remote(tid)) {
+      return;
+    }
+    timestamps[tid].value = clock_stop();
+    notifier.notify_local(tid);
+  }
+
+  bool supported() {
+    if constexpr (has_supported<Notifier>::value) {
+      return notifier.supported();
+    }
+    return true;
+  }
+
+  bool supports_non_interference() { return false; }
+
+  bool supports_energy_measurement() { return true; }
+};
+
 static constexpr int DEFAULT_NR_INTERFERING_THREADS = 1;
 
+/// How interfering threads are placed on the PUs that match a scenario.
+enum class Placement {
+  /// One thread per core first, SMT siblings only after every core is in use.
+  SPREAD,
+  /// Like SPREAD, but only on the package of the first matching PU.
+  PACKAGE,
+  /// Fill all SMT siblings of a core before moving to the next core.
+  SMT,
+};
+
+enum class Arrival {
+  /// Issue the next operation when the previous one returns.
+  CLOSED_LOOP,
+  /// Issue operations at a fixed rate.
+  FIXED,
+  /// Issue operations with exponentially distributed inter-arrival times.
+  POISSON,
+};
+
+/* Intended start times of operations in open-loop mode. The schedule does
+   not wait for operations to complete, so an operation that stalls delays
+   every operation scheduled behind it, like a request queue would.  */
+class ArrivalSchedule {
+  Arrival _arrival;
+  double _interval_ns;
+  double _next_ns;
+  std::mt19937_64 _rng;
+  std::exponential_distribution<double> _exp;
+
+ public:
+  ArrivalSchedule(Arrival arrival, double rate, uint64_t start_ns)
+      : _arrival{arrival}, _interval_ns{1e9 / rate}, _next_ns(start_ns), _exp{rate / 1e9} {}
+
+  /// Intended start time of the next operation (CLOCK_MONOTONIC in ns).
+  uint64_t next() {
+    uint64_t next_ns = _next_ns;
+    _next_ns += _arrival == Arrival::POISSON ? _exp(_rng) : _interval_ns;
+    return next_ns;
+  }
+};
+
+/// Default length of an interval histogram (in ms).
+static constexpr int DEFAULT_INTERVAL_MS = 1000;
+
 struct Config {
   /// Measuring CPU.
   int measuring_cpu;
@@ -121,22 +470,118 @@ struct Config {
   Scenario scenario;
   /// Number of interfering threads.
   size_t nr_interfering_threads = DEFAULT_NR_INTERFERING_THREADS;
+  /// Placement of interfering threads.
+  Placement placement = Placement::SPREAD;
+  /// Restrict interfering threads to these CPUs (hwloc cpulist, e.g. "2,4-7").
+  std::string cpulist;
   /// Name of the benchmark.
   std::string benchmark;
   /// Latency measurement duration (in seconds).
   int duration;
+  /// Subtract the clock overhead from every sample.
+  bool subtract_overhead = false;
+  /// Number of raw operations timed together per sample (0 = not batched).
+  size_t batch_size = 0;
+  /// Pick the batch size automatically so that a batch takes about
+  /// DEFAULT_BATCH_TARGET_NS.
+  bool auto_batch = false;
+  /// When operations are issued.
+  Arrival arrival = Arrival::CLOSED_LOOP;
+  /// Target arrival rate in open-loop mode (operations per second).
+  double arrival_rate = 0;
+  /// Length of an interval histogram.
+  std::chrono::milliseconds interval{DEFAULT_INTERVAL_MS};
 };
 
-static std::atomic<bool> sigint_fired = false;
+/// Target duration of a batch when the batch size is picked automatically.
+static constexpr uint64_t DEFAULT_BATCH_TARGET_NS = 1000;
+
+/// Upper bound for automatically picked batch sizes.
+static constexpr size_t MAX_BATCH_SIZE = 1 << 20;
+
+/// Time a loop of @batch_size raw operations (in ns).
+template <typename Action, typename State>
+inline uint64_t measure_batch(Action& action, State& state, size_t batch_size) {
+  uint64_t start = clock_start();
+  for (size_t i = 0; i < batch_size; i++) {
+    action.raw_operation(state);
+  }
+  uint64_t end = clock_stop();
+  return clock_elapsed(start, end);
+}
+
+/// Find the smallest power-of-two batch size that takes at least @target_ns.
+/// Every candidate is timed a few times and the fastest run is used so that a
+/// single preempted batch does not end the search early.
+template <typename Action, typename State>
+inline size_t calibrate_batch_size(Action& action, State& state, uint64_t target_ns) {
+  constexpr int NR_TRIES = 5;
+  size_t batch_size = 1;
+  while (batch_size < MAX_BATCH_SIZE) {
+    uint64_t elapsed = UINT64_MAX;
+    for (int i = 0; i < NR_TRIES; i++) {
+      elapsed = std::min(elapsed, measure_batch(action, state, batch_size));
+    }
+    if (elapsed >= target_ns) {
+      break;
+    }
+    batch_size *= 2;
+  }
+  return batch_size;
+}
+
+template <typename T>
+inline void write_latency_row(std::ostream& out, Scenario scenario, const char *key, T value) {
+  out << to_string(scenario);
+  out << ",";
+  out << key;
+  out << ",";
+  out << value;
+  out << std::endl;
+}
+
+/// Write percentiles 1..99 and the tail percentiles of @hist.
+inline void write_latency_percentiles(std::ostream& out, Scenario scenario, struct hdr_histogram *hist) {
+  for (size_t percentile = 1; percentile < 100; percentile++) {
+    out << to_string(scenario);
+    out << ",";
+    out << (double)percentile;
+    out << ",";
+    out << hdr_value_at_percentile(hist, percentile);
+    out << std::endl;
+  }
+  std::array<double, 4> tail_percentiles = {
+      99.9,
+      99.99,
+      99.999,
+      100,
+  };
+  for (auto percentile : tail_percentiles) {
+    out << to_string(scenario);
+    out << ",";
+    out << (double)percentile;
+    out << ",";
+    out << hdr_value_at_percentile(hist, percentile);
+    out << std::endl;
+  }
+}
+
+inline std::atomic<bool> sigint_fired = false;
 
-static void signal_handler(int signum) {
+/// Set when the user interrupts the benchmark run.
+inline std::atomic<bool> interrupted = false;
+
+static void signal_handler(int signum, siginfo_t *info, void *ucontext) {
   /* SIGINT is sent by user who wants to quit or sent by the measuring thread
      to the interfering threads to make sure they return from
      blocked system calls.  */
   sigint_fired = true;
+  if (info->si_code != SI_TKILL) {
+    interrupted = true;
+  }
 }
 
-static std::atomic<bool> alarm_fired = false;
+inline std::atomic<bool> alarm_fired = false;
 
 inline void alarm_signal_handler(int signum) {
   alarm_fired = true;
@@ -151,59 +596,594 @@ inline std::optional<hwloc_obj_t> find_package(hwloc_obj_t obj) {
   return std::nullopt;
 }
 
-inline std::optional<hwloc_obj_t> find_other_pu(hwloc_topology_t topology, hwloc_obj_t pu, Scenario scenario) {
+inline bool matches_scenario(hwloc_obj_t pu, hwloc_obj_t other_pu, Scenario scenario) {
   hwloc_obj_t core = pu->parent;
+  hwloc_obj_t other_core = other_pu->parent;
   auto package = find_package(core);
-  if (!package) {
-    return std::nullopt;
-  }
-  while ((pu = hwloc_get_next_obj_by_type(topology, HWLOC_OBJ_PU, pu))) {
-    hwloc_obj_t other_core = pu->parent;
-    auto other_package = find_package(other_core);
-    if (!other_package) {
-      return std::nullopt;
-    }
-    switch (scenario) {
-      case NO_INTERFERENCE:
-        return std::nullopt;
-      case REMOTE_PACKAGE:
-        if (package != other_package) {
-          return pu;
-        }
-        break;
-      case REMOTE_CORE:
-        if (package == other_package && core != other_core) {
-          return pu;
-        }
-        break;
-      case LOCAL_CORE:
-        if (core == other_core) {
-          return pu;
+  auto other_package = find_package(other_core);
+  if (!package || !other_package) {
+    return false;
+  }
+  switch (scenario) {
+    case NO_INTERFERENCE:
+      return false;
+    case REMOTE_PACKAGE:
+      return package != other_package;
+    case REMOTE_CORE:
+      return package == other_package && core != other_core;
+    case LOCAL_CORE:
+      return core == other_core;
+  }
+  assert(0);
+}
+
+/// Find the PUs to run interfering threads on. The PUs match @scenario
+/// relative to @pu, are restricted to @cpulist if it is not empty, and are
+/// ordered by @placement. Interfering thread N runs on PU (N % size).
+inline std::vector<hwloc_obj_t> find_other_pus(hwloc_topology_t topology, hwloc_obj_t pu, Scenario scenario, Placement placement, const std::string& cpulist) {
+  hwloc_bitmap_t allowed = hwloc_bitmap_alloc_full();
+  if (!cpulist.empty() && hwloc_bitmap_list_sscanf(allowed, cpulist.c_str()) < 0) {
+    hwloc_bitmap_free(allowed);
+    throw std::invalid_argument("invalid '" + cpulist + "' cpulist");
+  }
+  std::vector<hwloc_obj_t> pus;
+  hwloc_obj_t other_pu = nullptr;
+  while ((other_pu = hwloc_get_next_obj_by_type(topology, HWLOC_OBJ_PU, other_pu))) {
+    if (other_pu != pu && matches_scenario(pu, other_pu, scenario) && hwloc_bitmap_isset(allowed, other_pu->os_index)) {
+      pus.push_back(other_pu);
+    }
+  }
+  hwloc_bitmap_free(allowed);
+  if (pus.empty()) {
+    return pus;
+  }
+  switch (placement) {
+    case Placement::PACKAGE: {
+      auto package = find_package(pus.front()->parent);
+      pus.erase(std::remove_if(pus.begin(), pus.end(), [&package](hwloc_obj_t other_pu) {
+        return find_package(other_pu->parent) != package;
+      }), pus.end());
+      [[fallthrough]];
+    }
+    case Placement::SPREAD:
+      std::stable_sort(pus.begin(), pus.end(), [](hwloc_obj_t a, hwloc_obj_t b) {
+        return a->sibling_rank < b->sibling_rank;
+      });
+      break;
+    case Placement::SMT:
+      break;
+  }
+  return pus;
+}
+
+/// The hardware topology, which is loaded once and shared by all benchmarks.
+inline hwloc_topology_t shared_topology() {
+  static hwloc_topology_t topology = [] {
+    hwloc_topology_t topology;
+    hwloc_topology_init(&topology);
+    hwloc_topology_load(topology);
+    return topology;
+  }();
+  return topology;
+}
+
+/* A pool of threads that outlive a single benchmark run, so that running
+   many benchmarks in one process does not create and tear down threads for
+   every scenario. A task runs with the signal mask of the thread that
+   submitted it, like a new thread inherits the signal mask of its creator.  */
+class ThreadPool {
+  struct Worker {
+    std::mutex lock;
+    std::condition_variable cond;
+    std::function<void()> task;
+    sigset_t mask;
+    bool exit = false;
+  };
+
+  std::deque<Worker> _workers;
+  ThreadVector _threads;
+
+ public:
+  ~ThreadPool() {
+    for (auto& worker : _workers) {
+      std::lock_guard<std::mutex> guard(worker.lock);
+      worker.exit = true;
+      worker.cond.notify_all();
+    }
+    for (std::thread &t : _threads) {
+      t.join();
+    }
+  }
+
+  /// Threads of the pool. Thread N runs the tasks submitted to worker N.
+  const ThreadVector& threads() const { return _threads; }
+
+  /// Make sure the pool has at least @nr_threads threads.
+  void reserve(size_t nr_threads) {
+    while (_threads.size() < nr_threads) {
+      Worker& worker = _workers.emplace_back();
+      _threads.emplace_back([&worker]() { run_worker(worker); });
+    }
+  }
+
+  /// Run @task on thread @idx.
+  void submit(size_t idx, std::function<void()> task) {
+    reserve(idx + 1);
+    Worker& worker = _workers[idx];
+    std::lock_guard<std::mutex> guard(worker.lock);
+    assert(!worker.task);
+    ::pthread_sigmask(SIG_SETMASK, nullptr, &worker.mask);
+    worker.task = std::move(task);
+    worker.cond.notify_all();
+  }
+
+  /// Wait for the task running on thread @idx to complete.
+  void wait(size_t idx) {
+    Worker& worker = _workers[idx];
+    std::unique_lock<std::mutex> guard(worker.lock);
+    worker.cond.wait(guard, [&worker] { return !worker.task; });
+  }
+
+ private:
+  static void run_worker(Worker& worker) {
+    std::unique_lock<std::mutex> guard(worker.lock);
+    for (;;) {
+      worker.cond.wait(guard, [&worker] { return worker.task || worker.exit; });
+      if (worker.exit) {
+        return;
+      }
+      ::pthread_sigmask(SIG_SETMASK, &worker.mask, nullptr);
+      guard.unlock();
+      worker.task();
+      guard.lock();
+      worker.task = nullptr;
+      worker.cond.notify_all();
+    }
+  }
+};
+
+/// Threads that run interfering operations.
+inline ThreadPool& interfering_pool() {
+  static ThreadPool pool;
+  return pool;
+}
+
+/// Threads that run measured operations.
+inline ThreadPool& measuring_pool() {
+  static ThreadPool pool;
+  return pool;
+}
+
+/// A hardware or software event counted around every latency sample.
+struct PerfEvent {
+  const char *name;
+  uint32_t type;
+  uint64_t config;
+};
+
+#ifdef __linux__
+static constexpr uint64_t hw_cache_miss(uint64_t cache) {
+  return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+static const std::array<PerfEvent, 6> perf_events = {{
+  {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+  {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+  {"dtlb-misses", PERF_TYPE_HW_CACHE, hw_cache_miss(PERF_COUNT_HW_CACHE_DTLB)},
+  {"llc-misses", PERF_TYPE_HW_CACHE, hw_cache_miss(PERF_COUNT_HW_CACHE_LL)},
+  {"context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+  {"page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+}};
+#else
+static const std::array<PerfEvent, 0> perf_events = {};
+#endif
+
+/* A perf_event_open group that counts perf_events on the calling thread, in
+   user and kernel mode, or in user mode only if perf_event_paranoid does not
+   allow counting the kernel. Events that the kernel or the hardware do not
+   support are skipped. The counters are read outside of the timed interval,
+   so reading them does not add to the measured latency. If the group is not
+   on the PMU all the time, for example because the kernel multiplexes more
+   events than there are counters or the NMI watchdog holds one, the counts
+   are scaled by the time the group was enabled over the time it ran.
+   Samples during which the group did not run at all are skipped. The counts
+   of reading the counters themselves are measured like clock_overhead() and
+   subtracted from every sample.  */
+class PerfCounters {
+  std::vector<int> _fds;
+  std::vector<const char *> _names;
+  std::vector<uint64_t> _buf;
+  /// Shortest count of every event between back-to-back readings.
+  std::vector<uint64_t> _overhead;
+  /// Number of samples whose counts were scaled.
+  uint64_t _nr_scaled = 0;
+  /// Number of samples during which the group did not run at all.
+  uint64_t _nr_unscheduled = 0;
+
+ public:
+  PerfCounters() {
+#ifdef __linux__
+    bool user_only = false;
+    for (auto& event : perf_events) {
+      struct perf_event_attr attr;
+      ::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = event.type;
+      attr.config = event.config;
+      attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      attr.exclude_hv = 1;
+      attr.exclude_kernel = user_only;
+      int group_fd = _fds.empty() ? -1 : _fds.front();
+      int fd = ::syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+      if (fd < 0 && errno == EACCES && !user_only) {
+        attr.exclude_kernel = 1;
+        fd = ::syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+        if (fd >= 0) {
+          std::cerr << "warning: counting events in user mode only (see perf_event_paranoid)" << std::endl;
+          user_only = true;
         }
-        break;
+      }
+      if (fd < 0) {
+        std::cerr << "warning: unable to count " << event.name << " (" << ::strerror(errno) << ")" << std::endl;
+        continue;
+      }
+      _fds.push_back(fd);
+      _names.push_back(event.name);
     }
+#endif
+    _buf.resize(_fds.size() + 3);
+    _overhead = measure_overhead();
   }
-  return std::nullopt;
+
+  ~PerfCounters() {
+    if (_nr_unscheduled) {
+      std::cerr << "warning: events were not counted during " << _nr_unscheduled << " samples (PMU counters are in use)" << std::endl;
+    }
+    if (_nr_scaled) {
+      std::cerr << "warning: event counts of " << _nr_scaled << " samples are scaled estimates (events were multiplexed)" << std::endl;
+    }
+    for (int fd : _fds) {
+      ::close(fd);
+    }
+  }
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  /// Number of events that are counted.
+  size_t size() const { return _fds.size(); }
+
+  /// Name of event @idx.
+  const char *name(size_t idx) const { return _names[idx]; }
+
+  /// Read the current value of every event into @values, followed by the
+  /// time that the group was enabled and the time that it ran.
+  void read(std::vector<uint64_t>& values) {
+    values.resize(_fds.size() + 2);
+    if (_fds.empty()) {
+      return;
+    }
+    size_t len = _buf.size() * sizeof(uint64_t);
+    if (::read(_fds.front(), _buf.data(), len) != ssize_t(len)) {
+      assert(0);
+    }
+    /* The buffer starts with the number of events and the times, which
+       read() returns after the values.  */
+    std::copy(_buf.begin() + 3, _buf.end(), values.begin());
+    values[_fds.size()] = _buf[1];
+    values[_fds.size() + 1] = _buf[2];
+  }
+
+  /// Return the counts of every event between the readings @begin and @end
+  /// in @deltas, less the overhead of reading them and scaled up if the
+  /// group did not run all the time. Return false if the group did not run
+  /// at all, in which case the sample has no counts.
+  bool delta(const std::vector<uint64_t>& begin, const std::vector<uint64_t>& end, std::vector<uint64_t>& deltas) {
+    size_t nr_events = _fds.size();
+    deltas.resize(nr_events);
+    if (!nr_events) {
+      return true;
+    }
+    uint64_t enabled = end[nr_events] - begin[nr_events];
+    uint64_t running = end[nr_events + 1] - begin[nr_events + 1];
+    if (running == 0) {
+      _nr_unscheduled++;
+      return false;
+    }
+    if (running < enabled) {
+      _nr_scaled++;
+    }
+    for (size_t i = 0; i < nr_events; i++) {
+      uint64_t count = end[i] - begin[i];
+      count = count > _overhead[i] ? count - _overhead[i] : 0;
+      if (running < enabled) {
+        count = uint64_t(double(count) * double(enabled) / double(running));
+      }
+      deltas[i] = count;
+    }
+    return true;
+  }
+
+ private:
+  /// Measure the shortest count of every event between back-to-back
+  /// readings, over the readings during which the group ran all the time.
+  std::vector<uint64_t> measure_overhead(size_t nr_iterations = 1000) {
+    size_t nr_events = _fds.size();
+    std::vector<uint64_t> overhead(nr_events, UINT64_MAX);
+    std::vector<uint64_t> begin, end;
+    for (size_t i = 0; i < nr_iterations; i++) {
+      read(begin);
+      read(end);
+      if (!nr_events || end[nr_events + 1] - begin[nr_events + 1] != end[nr_events] - begin[nr_events]) {
+        continue;
+      }
+      for (size_t j = 0; j < nr_events; j++) {
+        overhead[j] = std::min(overhead[j], end[j] - begin[j]);
+      }
+    }
+    for (auto& count : overhead) {
+      if (count == UINT64_MAX) {
+        count = 0;
+      }
+    }
+    return overhead;
+  }
+};
+
+/// Write the per-operation distribution of every counted event.
+inline void write_counter_rows(std::ostream& out, Scenario scenario, const PerfCounters& counters, const std::vector<struct hdr_histogram *>& hists, const std::vector<uint64_t>& totals, uint64_t nr_ops) {
+  for (size_t i = 0; i < counters.size(); i++) {
+    out << to_string(scenario);
+    out << ",";
+    out << counters.name(i);
+    out << ",";
+    out << double(totals[i]) / double(nr_ops);
+    for (double percentile : {50.0, 90.0, 99.0, 99.9, 100.0}) {
+      out << ",";
+      out << hdr_value_at_percentile(hists[i], percentile);
+    }
+    out << std::endl;
+  }
+}
+
+/* A minimal streaming JSON writer that emits compact output. Commas between
+   members and elements are inserted automatically.  */
+class JsonWriter {
+  std::ostream& _out;
+  std::vector<bool> _first;
+
+ public:
+  JsonWriter(std::ostream& out) : _out{out} {}
+
+  void begin_object() {
+    separate();
+    _out << "{";
+    _first.push_back(true);
+  }
+
+  void end_object() {
+    _first.pop_back();
+    _out << "}";
+  }
+
+  void begin_array() {
+    separate();
+    _out << "[";
+    _first.push_back(true);
+  }
+
+  void end_array() {
+    _first.pop_back();
+    _out << "]";
+  }
+
+  /// Start an object member. The next value is the value of the member.
+  void key(const std::string& name) {
+    separate();
+    write_string(name);
+    _out << ":";
+    _first.back() = true;
+  }
+
+  void value(const std::string& s) {
+    separate();
+    write_string(s);
+  }
+
+  void value(const char *s) { value(std::string(s)); }
+
+  void value(bool b) {
+    separate();
+    _out << (b ? "true" : "false");
+  }
+
+  void value(double d) {
+    separate();
+    if (std::isfinite(d)) {
+      _out << d;
+    } else {
+      _out << "null";
+    }
+  }
+
+  template <typename T, typename = std::enable_if_t<std::is_integral_v<T>>>
+  void value(T n) {
+    separate();
+    _out << n;
+  }
+
+  template <typename T>
+  void field(const std::string& name, const T& v) {
+    key(name);
+    value(v);
+  }
+
+ private:
+  void separate() {
+    if (_first.empty()) {
+      return;
+    }
+    if (!_first.back()) {
+      _out << ",";
+    }
+    _first.back() = false;
+  }
+
+  void write_string(const std::string& s) {
+    _out << '"';
+    for (char c : s) {
+      switch (c) {
+        case '"':
+          _out << "\\\"";
+          break;
+        case '\\':
+          _out << "\\\\";
+          break;
+        case '\n':
+          _out << "\\n";
+          break;
+        default:
+          if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            _out << buf;
+          } else {
+            _out << c;
+          }
+      }
+    }
+    _out << '"';
+  }
+};
+
+/// Write the kernel and CPU of the host.
+inline void write_host_metadata(JsonWriter& json, hwloc_topology_t topology) {
+  struct utsname uts;
+  json.key("host");
+  json.begin_object();
+  if (::uname(&uts) == 0) {
+    json.field("hostname", uts.nodename);
+    json.field("sysname", uts.sysname);
+    json.field("release", uts.release);
+    json.field("version", uts.version);
+    json.field("machine", uts.machine);
+  }
+  hwloc_obj_t package = hwloc_get_obj_by_type(topology, HWLOC_OBJ_PACKAGE, 0);
+  const char *cpu_model = package ? hwloc_obj_get_info_by_name(package, "CPUModel") : nullptr;
+  if (cpu_model) {
+    json.field("cpu_model", cpu_model);
+  }
+  json.field("packages", hwloc_get_nbobjs_by_type(topology, HWLOC_OBJ_PACKAGE));
+  json.field("cores", hwloc_get_nbobjs_by_type(topology, HWLOC_OBJ_CORE));
+  json.field("pus", hwloc_get_nbobjs_by_type(topology, HWLOC_OBJ_PU));
+  json.end_object();
 }
 
+/// Output streams of a latency benchmark. Optional outputs are null when
+/// they are not requested.
+struct LatencyOutput {
+  /// Latency of every operation.
+  std::ostream& latency;
+  /// Latency of whole batches.
+  std::ostream *batch = nullptr;
+  /// Hardware and software events per operation.
+  std::ostream *counters = nullptr;
+  /// Latency of every operation without the time it waited to be issued,
+  /// in open-loop mode.
+  std::ostream *service = nullptr;
+  /// Histogram log that receives one latency histogram per interval.
+  FILE *intervals = nullptr;
+  /// JSON document that receives one result object per scenario.
+  JsonWriter *json = nullptr;
+};
+
+/* Moves the samples of an interval recorder into a histogram log at every
+   interval while the measuring thread keeps recording, so that a long run
+   can be inspected while it runs and an interrupted run keeps every
+   completed interval. The last, partial interval is written when the logger
+   is destroyed. The logger thread runs off the measuring PU, so that
+   compressing and writing a histogram does not preempt the measurement.  */
+class IntervalLogger {
+  struct hdr_interval_recorder *_recorder;
+  FILE *_file;
+  std::chrono::milliseconds _interval;
+  struct hdr_log_writer _writer;
+  hdr_timespec _start;
+  std::mutex _lock;
+  std::condition_variable _cond;
+  bool _stop = false;
+  std::thread _thread;
+
+ public:
+  IntervalLogger(struct hdr_interval_recorder *recorder, FILE *file, std::chrono::milliseconds interval,
+                 hwloc_topology_t topology, hwloc_obj_t measuring_pu)
+      : _recorder{recorder}, _file{file}, _interval{interval} {
+    hdr_log_writer_init(&_writer);
+    ::clock_gettime(CLOCK_REALTIME, &_start);
+    _thread = std::thread([this, topology, measuring_pu]() {
+      bind_off(topology, measuring_pu);
+      run();
+    });
+  }
+
+  ~IntervalLogger() {
+    {
+      std::lock_guard<std::mutex> guard(_lock);
+      _stop = true;
+      _cond.notify_all();
+    }
+    _thread.join();
+    write_interval();
+  }
+
+  IntervalLogger(const IntervalLogger&) = delete;
+  IntervalLogger& operator=(const IntervalLogger&) = delete;
+
+ private:
+  /// Bind the calling thread to every PU except @pu, unless @pu is the only
+  /// one.
+  static void bind_off(hwloc_topology_t topology, hwloc_obj_t pu) {
+    hwloc_bitmap_t cpuset = hwloc_bitmap_dup(hwloc_get_root_obj(topology)->cpuset);
+    hwloc_bitmap_andnot(cpuset, cpuset, pu->cpuset);
+    if (!hwloc_bitmap_iszero(cpuset)) {
+      hwloc_set_cpubind(topology, cpuset, HWLOC_CPUBIND_THREAD);
+    }
+    hwloc_bitmap_free(cpuset);
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> guard(_lock);
+    while (!_cond.wait_for(guard, _interval, [this] { return _stop; })) {
+      write_interval();
+    }
+  }
+
+  void write_interval() {
+    hdr_timespec end;
+    ::clock_gettime(CLOCK_REALTIME, &end);
+    struct hdr_histogram *hist = hdr_interval_recorder_sample(_recorder);
+    if (hdr_log_write(&_writer, _file, &_start, &end, hist)) {
+      std::cerr << "warning: unable to write interval histogram" << std::endl;
+    }
+    ::fflush(_file);
+    _start = end;
+  }
+};
+
 template <class Action>
 class LatencyBenchmark {
-  ThreadVector _interfering_threads;
-
  public:
-  void run(const Config &cfg, std::ostream& out) {
+  void run(const Config &cfg, const LatencyOutput& output) {
 #if 0
     printf("# %s: Measuring thread on CPU %d, intefering thread on CPU %d\n",
            to_string(cfg.scenario), pu->os_index, (*other_pu)->os_index);
 #endif
-    hwloc_topology_t topology;
-    hwloc_topology_init(&topology);
-    hwloc_topology_load(topology);
+    hwloc_topology_t topology = shared_topology();
     hwloc_obj_t pu = hwloc_get_obj_by_type(topology, HWLOC_OBJ_PU, cfg.measuring_cpu);
-    std::optional<hwloc_obj_t> other_pu;
+    std::vector<hwloc_obj_t> other_pus;
     if (cfg.scenario != NO_INTERFERENCE) {
-        other_pu = find_other_pu(topology, pu, cfg.scenario);
-        if (!other_pu) {
+        other_pus = find_other_pus(topology, pu, cfg.scenario, cfg.placement, cfg.cpulist);
+        if (other_pus.empty()) {
           std::cerr << "warning: Unable to find other PU for scenario: " << to_string(cfg.scenario) << std::endl;;
           return;
         }
@@ -212,127 +1192,318 @@ class LatencyBenchmark {
     if (cfg.scenario == NO_INTERFERENCE && !action.supports_non_interference()) {
         return;
     }
-    std::cout << "Measuring latency for " << cfg.benchmark << " (" << to_string(cfg.scenario) << ") ..." << std::endl;
-    sigint_fired = false;
-    std::atomic<bool> stop = false;
-    if (other_pu) {
-      _interfering_threads.resize(cfg.nr_interfering_threads);
-      for (size_t tid = 0; tid < cfg.nr_interfering_threads; tid++) {
-        std::thread interfering_thread([this, &cfg, &topology, &other_pu, &stop, &action, tid]() {
-          hwloc_set_cpubind(topology, (*other_pu)->cpuset, HWLOC_CPUBIND_THREAD);
-
-          auto state = action.make_state(_interfering_threads);
-
-          while (!stop.load(std::memory_order_relaxed)) {
-            action.other_operation(state, tid);
-          }
-        });
-        _interfering_threads[tid] = std::move(interfering_thread);
-      }
+    if (!is_supported(action, cfg.benchmark)) {
+        return;
+    }
+    std::cout << "Measuring latency for " << cfg.benchmark << " (" << to_string(cfg.scenario) << ") ..." << std::endl;
+    sigint_fired = false;
+    std::atomic<bool> stop = false;
+    auto& interfering_threads = interfering_pool();
+    size_t nr_interfering_threads = other_pus.empty() ? 0 : cfg.nr_interfering_threads;
+    interfering_threads.reserve(nr_interfering_threads);
+    for (size_t tid = 0; tid < nr_interfering_threads; tid++) {
+      hwloc_obj_t other_pu = other_pus[tid % other_pus.size()];
+      interfering_threads.submit(tid, [&interfering_threads, &topology, other_pu, &stop, &action, tid]() {
+        hwloc_set_cpubind(topology, other_pu->cpuset, HWLOC_CPUBIND_THREAD);
+
+        auto state = action.make_state(interfering_threads.threads());
+
+        while (!stop.load(std::memory_order_relaxed)) {
+          action.other_operation(state, tid);
+        }
+      });
     }
-    std::thread t([this, &cfg, &topology, &pu, &action, &stop, &out]() {
+    measuring_pool().submit(0, [&interfering_threads, &cfg, &topology, &pu, &action, &stop, &output]() {
       hwloc_set_cpubind(topology, pu->cpuset, HWLOC_CPUBIND_THREAD);
-      auto state = action.make_state(_interfering_threads);
+      auto state = action.make_state(interfering_threads.threads());
       struct hdr_histogram *hist;
       if (hdr_init(1, INT64_C(3600000000), 3, &hist)) {
         assert(0);
       }
+      struct hdr_histogram *batch_hist = nullptr;
+      if (output.batch && hdr_init(1, INT64_C(3600000000), 3, &batch_hist)) {
+        assert(0);
+      }
+      struct hdr_histogram *service_hist = nullptr;
+      if (output.service && hdr_init(1, INT64_C(3600000000), 3, &service_hist)) {
+        assert(0);
+      }
+
+      std::optional<PerfCounters> counters;
+      std::vector<struct hdr_histogram *> counter_hists;
+      std::vector<uint64_t> counter_totals;
+      std::vector<uint64_t> counters_begin, counters_end, counter_deltas;
+      uint64_t nr_ops = 0;
+      if (output.counters) {
+        counters.emplace();
+        counter_hists.resize(counters->size());
+        counter_totals.resize(counters->size());
+        for (auto& counter_hist : counter_hists) {
+          if (hdr_init(1, INT64_C(3600000000), 3, &counter_hist)) {
+            assert(0);
+          }
+        }
+      }
+
+      uint64_t overhead = clock_overhead();
+
+      size_t batch_size = cfg.batch_size;
+      if (cfg.auto_batch) {
+        batch_size = calibrate_batch_size(action, state, DEFAULT_BATCH_TARGET_NS);
+      }
 
       ::alarm(cfg.duration);
       alarm_fired = false;
 
       uint64_t nr_samples = 0;
 
+      struct hdr_interval_recorder recorder;
+      std::optional<IntervalLogger> logger;
+      if (output.intervals) {
+        if (hdr_interval_recorder_init_all(&recorder, 1, INT64_C(3600000000), 3)) {
+          assert(0);
+        }
+        fprintf(output.intervals, "#[Scenario: %s]\n", to_string(cfg.scenario));
+        logger.emplace(&recorder, output.intervals, cfg.interval, topology, pu);
+      }
+      auto record = [&](int64_t value) {
+        assert(hdr_record_value(hist, value));
+        if (logger) {
+          hdr_interval_recorder_record_value(&recorder, value);
+        }
+      };
+
+      std::optional<ArrivalSchedule> schedule;
+      if (cfg.arrival != Arrival::CLOSED_LOOP) {
+        schedule.emplace(cfg.arrival, cfg.arrival_rate, MonotonicClock::now());
+      }
+
+      uint64_t loop_start = MonotonicClock::now();
+
       while (!sigint_fired && !alarm_fired) {
-        auto diff = action.measured_operation(state);
-	nr_samples++;
-        assert(hdr_record_value(hist, diff));
+        if (batch_size) {
+          if (counters) {
+            counters->read(counters_begin);
+          }
+          auto total = measure_batch(action, state, batch_size);
+          if (counters) {
+            counters->read(counters_end);
+          }
+          if (cfg.subtract_overhead) {
+            total = total > overhead ? total - overhead : 0;
+          }
+          nr_samples++;
+          record(total / batch_size);
+          if (batch_hist) {
+            assert(hdr_record_value(batch_hist, total));
+          }
+        } else if (schedule) {
+          /* Measure from the intended start time so that the time an
+             operation spent waiting behind a stalled one is included.  */
+          uint64_t intended = schedule->next();
+          uint64_t now;
+          while ((now = MonotonicClock::now()) < intended) {
+            if (sigint_fired || alarm_fired) {
+              break;
+            }
+          }
+          if (now < intended) {
+            break;
+          }
+          /* Count events from here so that the wait is not counted.  */
+          if (counters) {
+            counters->read(counters_begin);
+          }
+          auto diff = action.measured_operation(state);
+          /* The response time is taken on the clock of the schedule, so it
+             includes everything between the intended start and the return
+             of the operation.  */
+          uint64_t completion = MonotonicClock::now();
+          if (counters) {
+            counters->read(counters_end);
+          }
+          if (cfg.subtract_overhead) {
+            diff = diff > overhead ? diff - overhead : 0;
+          }
+          nr_samples++;
+          record(completion - intended);
+          if (service_hist) {
+            assert(hdr_record_value(service_hist, diff));
+          }
+        } else {
+          if (counters) {
+            counters->read(counters_begin);
+          }
+          auto diff = action.measured_operation(state);
+          if (counters) {
+            counters->read(counters_end);
+          }
+          if (cfg.subtract_overhead) {
+            diff = diff > overhead ? diff - overhead : 0;
+          }
+          nr_samples++;
+          record(diff);
+        }
+        /* The end of the sample was read right after the operation, so the
+           counts do not include recording the latency.  */
+        if (counters && counters->delta(counters_begin, counters_end, counter_deltas)) {
+          size_t sample_ops = batch_size ? batch_size : 1;
+          for (size_t i = 0; i < counters->size(); i++) {
+            counter_totals[i] += counter_deltas[i];
+            assert(hdr_record_value(counter_hists[i], counter_deltas[i] / sample_ops));
+          }
+          nr_ops += sample_ops;
+        }
       }
+      uint64_t loop_elapsed = MonotonicClock::now() - loop_start;
       stop.store(true);
 
-      out << to_string(cfg.scenario);
-      out << ",";
-      out << "mean";
-      out << ",";
-      out << hdr_mean(hist);
-      out << std::endl;
+      /* Throughput in MB/s or tasks/s over the whole measurement, including
+         the time spent between operations, and mean latency per byte.  */
+      uint64_t nr_loop_ops = nr_samples * (batch_size ? batch_size : 1);
+      double throughput = 0;
+      double ns_per_byte = 0;
+      if (size_t bytes = bytes_per_operation(action)) {
+        throughput = double(nr_loop_ops) * double(bytes) * 1e3 / double(loop_elapsed);
+        ns_per_byte = hdr_mean(hist) / double(bytes);
+      }
+      double tasks_per_sec = 0;
+      if (size_t tasks = tasks_per_operation(action)) {
+        tasks_per_sec = double(nr_loop_ops) * double(tasks) * 1e9 / double(loop_elapsed);
+      }
 
-      out << to_string(cfg.scenario);
-      out << ",";
-      out << "stddev";
-      out << ",";
-      out << hdr_stddev(hist);
-      out << std::endl;
+      if (logger) {
+        logger.reset();
+        hdr_interval_recorder_destroy(&recorder);
+      }
 
-      out << to_string(cfg.scenario);
-      out << ",";
-      out << "samples";
-      out << ",";
-      out << nr_samples;
-      out << std::endl;
-
-      for (size_t percentile = 1; percentile < 100; percentile++) {
-        out << to_string(cfg.scenario);
-	out << ",";
-	out << (double)percentile;
-	out << ",";
-	out << hdr_value_at_percentile(hist, percentile);
-	out << std::endl;
-      }
-      std::array<double, 4> tail_percentiles = {
-          99.9,
-          99.99,
-          99.999,
-          100,
-      };
-      for (auto percentile : tail_percentiles) {
-        out << to_string(cfg.scenario);
-	out << ",";
-	out << (double)percentile;
-	out << ",";
-	out << hdr_value_at_percentile(hist, percentile);
-	out << std::endl;
+      write_latency_row(output.latency, cfg.scenario, "mean", hdr_mean(hist));
+      write_latency_row(output.latency, cfg.scenario, "stddev", hdr_stddev(hist));
+      write_latency_row(output.latency, cfg.scenario, "samples", nr_samples);
+      write_latency_row(output.latency, cfg.scenario, "overhead", overhead);
+      if (batch_size) {
+        write_latency_row(output.latency, cfg.scenario, "batch", batch_size);
+      }
+      if (schedule) {
+        write_latency_row(output.latency, cfg.scenario, "rate", cfg.arrival_rate);
+      }
+      if (throughput) {
+        write_latency_row(output.latency, cfg.scenario, "throughput", throughput);
+        write_latency_row(output.latency, cfg.scenario, "ns_per_byte", ns_per_byte);
+      }
+      if (tasks_per_sec) {
+        write_latency_row(output.latency, cfg.scenario, "tasks_per_sec", tasks_per_sec);
+      }
+      write_latency_percentiles(output.latency, cfg.scenario, hist);
+      if (output.json) {
+        auto& json = *output.json;
+        json.begin_object();
+        json.field("scenario", to_string(cfg.scenario));
+        json.field("samples", nr_samples);
+        json.field("overhead", overhead);
+        if (batch_size) {
+          json.field("batch", batch_size);
+        }
+        if (schedule) {
+          json.field("rate", cfg.arrival_rate);
+        }
+        if (throughput) {
+          json.field("throughput", throughput);
+          json.field("ns_per_byte", ns_per_byte);
+        }
+        if (tasks_per_sec) {
+          json.field("tasks_per_sec", tasks_per_sec);
+        }
+        json.field("min", hdr_min(hist));
+        json.field("max", hdr_max(hist));
+        json.field("mean", hdr_mean(hist));
+        json.field("stddev", hdr_stddev(hist));
+        char *encoded;
+        if (hdr_log_encode(hist, &encoded) == 0) {
+          json.field("histogram", encoded);
+          ::free(encoded);
+        }
+        if (counters && nr_ops) {
+          json.key("counters");
+          json.begin_object();
+          for (size_t i = 0; i < counters->size(); i++) {
+            json.field(counters->name(i), double(counter_totals[i]) / double(nr_ops));
+          }
+          json.end_object();
+        }
+        json.end_object();
+      }
+      hdr_close(hist);
+
+      if (batch_hist) {
+        write_latency_row(*output.batch, cfg.scenario, "mean", hdr_mean(batch_hist));
+        write_latency_row(*output.batch, cfg.scenario, "stddev", hdr_stddev(batch_hist));
+        write_latency_row(*output.batch, cfg.scenario, "samples", nr_samples);
+        write_latency_row(*output.batch, cfg.scenario, "batch", batch_size);
+        write_latency_percentiles(*output.batch, cfg.scenario, batch_hist);
+        hdr_close(batch_hist);
+      }
+
+      if (service_hist) {
+        write_latency_row(*output.service, cfg.scenario, "mean", hdr_mean(service_hist));
+        write_latency_row(*output.service, cfg.scenario, "stddev", hdr_stddev(service_hist));
+        write_latency_row(*output.service, cfg.scenario, "samples", nr_samples);
+        write_latency_percentiles(*output.service, cfg.scenario, service_hist);
+        hdr_close(service_hist);
+      }
+
+      if (counters) {
+        if (nr_ops) {
+          write_counter_rows(*output.counters, cfg.scenario, *counters, counter_hists, counter_totals, nr_ops);
+        }
+        for (auto counter_hist : counter_hists) {
+          hdr_close(counter_hist);
+        }
       }
     });
 
-    t.join();
+    measuring_pool().wait(0);
 
-    for (std::thread &t : _interfering_threads) {
-      ::pthread_kill(t.native_handle(), SIGINT);
+    for (size_t tid = 0; tid < nr_interfering_threads; tid++) {
+      ::pthread_kill(const_cast<std::thread&>(interfering_threads.threads()[tid]).native_handle(), SIGINT);
     }
-    for (std::thread &t : _interfering_threads) {
-      t.join();
+    for (size_t tid = 0; tid < nr_interfering_threads; tid++) {
+      interfering_threads.wait(tid);
     }
     fflush(stdout);
-    hwloc_topology_destroy(topology);
   }
 };
 
 template <typename T>
-static void run_latency_benchmark(const std::string benchmark, int measuring_cpu, Scenario scenario, int duration, std::ostream& out) {
-  Config cfg;
-  cfg.measuring_cpu = measuring_cpu;
-  cfg.benchmark = benchmark;
+static void run_latency_benchmark(Config cfg, Scenario scenario, const LatencyOutput& output) {
   cfg.scenario = scenario;
-  cfg.duration = duration;
   LatencyBenchmark<T> bench;
-  bench.run(cfg, out);
+  bench.run(cfg, output);
 }
 
 template <typename T>
-static void run_latency_benchmarks(const std::string benchmark, int measuring_cpu, Interference interference, int duration, std::ostream& out) {
-  out << "scenario,percentile,time" << std::endl;
+static void run_latency_benchmarks(const Config& cfg, Interference interference, const LatencyOutput& output) {
+  output.latency << "scenario,percentile,time" << std::endl;
+  if (output.batch) {
+    *output.batch << "scenario,percentile,time" << std::endl;
+  }
+  if (output.counters) {
+    *output.counters << "scenario,counter,mean,p50,p90,p99,p99.9,max" << std::endl;
+  }
+  if (output.service) {
+    *output.service << "scenario,percentile,time" << std::endl;
+  }
   if (interference & Interference::REMOTE_PACKAGE) {
-    run_latency_benchmark<T>(benchmark, measuring_cpu, Scenario::REMOTE_PACKAGE, duration, out);
+    run_latency_benchmark<T>(cfg, Scenario::REMOTE_PACKAGE, output);
   }
   if (interference & Interference::REMOTE_CORE) {
-    run_latency_benchmark<T>(benchmark, measuring_cpu, Scenario::REMOTE_CORE, duration, out);
+    run_latency_benchmark<T>(cfg, Scenario::REMOTE_CORE, output);
   }
   if (interference & Interference::LOCAL_CORE) {
-    run_latency_benchmark<T>(benchmark, measuring_cpu, Scenario::LOCAL_CORE, duration, out);
+    run_latency_benchmark<T>(cfg, Scenario::LOCAL_CORE, output);
   }
   if (interference & Interference::NONE) {
-    run_latency_benchmark<T>(benchmark, measuring_cpu, Scenario::NO_INTERFERENCE, duration, out);
+    run_latency_benchmark<T>(cfg, Scenario::NO_INTERFERENCE, output);
   }
 }
 
@@ -346,6 +1517,22 @@ static void usage(std::string program)
 	    << " [-d <latency-duration>]"
 	    << " [-e <energy-output>]"
 	    << " [-s <energy samples>]"
+	    << " [-c <clock>]"
+	    << " [-O]"
+	    << " [-b <batch-size>|auto]"
+	    << " [-B <batch-output>]"
+	    << " [-C <counter-output>]"
+	    << " [-r <arrival-rate>]"
+	    << " [-a fixed|poisson]"
+	    << " [-S <service-time-output>]"
+	    << " [-L <interval-log>]"
+	    << " [-I <interval-ms>]"
+	    << " [-j <json-output>]"
+	    << " [-w <work-dir>]"
+	    << " [-t <scaling-output>]"
+	    << " [-k <max-scaling-threads>]"
+	    << " [-n <interfering-threads>]"
+	    << " [-P spread|package|smt|<cpulist>]"
 	    << std::endl;
 }
 
@@ -356,7 +1543,7 @@ enum {
   MSR_DRAM_ENERGY_STATUS = 0x619,
 };
 
-static int msr_fd = -1;
+inline int msr_fd = -1;
 
 static uint64_t read_msr(int msr_offset) {
   uint64_t ret;
@@ -391,6 +1578,10 @@ struct EnergyConfig {
   Scenario scenario;
   /// Number of interfering threads.
   size_t nr_interfering_threads = DEFAULT_NR_INTERFERING_THREADS;
+  /// Placement of interfering threads.
+  Placement placement = Placement::SPREAD;
+  /// Restrict interfering threads to these CPUs (hwloc cpulist, e.g. "2,4-7").
+  std::string cpulist;
   /// Name of the benchmark.
   std::string benchmark;
   /// Number of energy measurement samples.
@@ -449,22 +1640,18 @@ inline void measure_energy(const EnergyConfig &cfg, std::ostream &out, Action& a
 
 template <class Action>
 class EnergyBenchmark {
-  ThreadVector _interfering_threads;
-
  public:
   void run(const EnergyConfig &cfg, std::ostream &out) {
 #if 0
     printf("# %s: Measuring thread on CPU %d, intefering thread on CPU %d\n",
            to_string(cfg.scenario), pu->os_index, (*other_pu)->os_index);
 #endif
-    hwloc_topology_t topology;
-    hwloc_topology_init(&topology);
-    hwloc_topology_load(topology);
+    hwloc_topology_t topology = shared_topology();
     hwloc_obj_t pu = hwloc_get_obj_by_type(topology, HWLOC_OBJ_PU, cfg.measuring_cpu);
-    std::optional<hwloc_obj_t> other_pu;
+    std::vector<hwloc_obj_t> other_pus;
     if (cfg.scenario != NO_INTERFERENCE) {
-      other_pu = find_other_pu(topology, pu, cfg.scenario);
-      if (!other_pu) {
+      other_pus = find_other_pus(topology, pu, cfg.scenario, cfg.placement, cfg.cpulist);
+      if (other_pus.empty()) {
         std::cerr << "warning: Unable to find other PU for scenario: " << to_string(cfg.scenario) << std::endl;;
         return;
       }
@@ -473,27 +1660,30 @@ class EnergyBenchmark {
     if (cfg.scenario == NO_INTERFERENCE && !action.supports_non_interference()) {
       return;
     }
+    if (!is_supported(action, cfg.benchmark)) {
+      return;
+    }
     if (!action.supports_energy_measurement()) {
       return;
     }
     std::cout << "Measuring energy for " << cfg.benchmark << " (" << to_string(cfg.scenario) << ") ..." << std::endl;
     std::atomic<bool> stop = false;
-    if (other_pu) {
-      _interfering_threads.resize(cfg.nr_interfering_threads);
-      for (size_t tid = 0; tid < cfg.nr_interfering_threads; tid++) {
-        std::thread interfering_thread([this, &cfg, &topology, &other_pu, &stop, &action, tid]() {
-          hwloc_set_cpubind(topology, (*other_pu)->cpuset, HWLOC_CPUBIND_THREAD);
-    
-	  auto state = action.make_state(_interfering_threads);
-
-          while (!stop.load(std::memory_order_relaxed)) {
-            action.other_operation(state, tid);
-          }
-        });
-        _interfering_threads[tid] = std::move(interfering_thread);
-      }
+    auto& interfering_threads = interfering_pool();
+    size_t nr_interfering_threads = other_pus.empty() ? 0 : cfg.nr_interfering_threads;
+    interfering_threads.reserve(nr_interfering_threads);
+    for (size_t tid = 0; tid < nr_interfering_threads; tid++) {
+      hwloc_obj_t other_pu = other_pus[tid % other_pus.size()];
+      interfering_threads.submit(tid, [&interfering_threads, &topology, other_pu, &stop, &action, tid]() {
+        hwloc_set_cpubind(topology, other_pu->cpuset, HWLOC_CPUBIND_THREAD);
+
+        auto state = action.make_state(interfering_threads.threads());
+
+        while (!stop.load(std::memory_order_relaxed)) {
+          action.other_operation(state, tid);
+        }
+      });
     }
-    std::thread t([this, &cfg, &topology, &pu, &action, &stop, &out]() {
+    measuring_pool().submit(0, [&interfering_threads, &cfg, &topology, &pu, &action, &stop, &out]() {
       int cpu = pu->os_index;
       char msr_path[PATH_MAX];
       snprintf(msr_path, PATH_MAX, "/dev/cpu/%d/msr", cpu);
@@ -523,51 +1713,219 @@ class EnergyBenchmark {
       }
 
       for (int j = 0; j < cfg.nr_samples; j++) {
-        auto state = action.make_state(_interfering_threads);
+        auto state = action.make_state(interfering_threads.threads());
         measure_energy(cfg, out, action, state, energy_unit);
       }
+      ::close(msr_fd);
       stop.store(true);
     });
 
-    t.join();
+    measuring_pool().wait(0);
 
-    for (std::thread &t : _interfering_threads) {
-      ::pthread_kill(t.native_handle(), SIGINT);
+    for (size_t tid = 0; tid < nr_interfering_threads; tid++) {
+      ::pthread_kill(const_cast<std::thread&>(interfering_threads.threads()[tid]).native_handle(), SIGINT);
     }
-    for (std::thread &t : _interfering_threads) {
-      t.join();
+    for (size_t tid = 0; tid < nr_interfering_threads; tid++) {
+      interfering_threads.wait(tid);
     }
     fflush(stdout);
-    hwloc_topology_destroy(topology);
   }
 };
 
 template <typename T>
-static void run_energy_benchmark(std::string benchmark, int measuring_cpu, Scenario scenario, int nr_samples, std::ostream& out) {
-  EnergyConfig cfg;
-  cfg.measuring_cpu = measuring_cpu;
-  cfg.benchmark = benchmark;
+static void run_energy_benchmark(EnergyConfig cfg, Scenario scenario, std::ostream& out) {
   cfg.scenario = scenario;
-  cfg.nr_samples = nr_samples;
   EnergyBenchmark<T> bench;
   bench.run(cfg, out);
 }
 
 template <typename T>
-static void run_energy_benchmarks(std::string benchmark, int measuring_cpu, Interference interference, int nr_samples, std::ostream &out) {
+static void run_energy_benchmarks(const EnergyConfig& cfg, Interference interference, std::ostream &out) {
   out << "Benchmark,Scenario,Operations,DurationPerOperation(ns),PackageEnergyPerOperation(nJ),DRAMEnergyPerOperation(nJ)" << std::endl;
   if (interference & Interference::REMOTE_PACKAGE) {
-    run_energy_benchmark<T>(benchmark, measuring_cpu, Scenario::REMOTE_PACKAGE, nr_samples, out);
+    run_energy_benchmark<T>(cfg, Scenario::REMOTE_PACKAGE, out);
   }
   if (interference & Interference::REMOTE_CORE) {
-    run_energy_benchmark<T>(benchmark, measuring_cpu, Scenario::REMOTE_CORE, nr_samples, out);
+    run_energy_benchmark<T>(cfg, Scenario::REMOTE_CORE, out);
   }
   if (interference & Interference::LOCAL_CORE) {
-    run_energy_benchmark<T>(benchmark, measuring_cpu, Scenario::LOCAL_CORE, nr_samples, out);
+    run_energy_benchmark<T>(cfg, Scenario::LOCAL_CORE, out);
   }
   if (interference & Interference::NONE) {
-    run_energy_benchmark<T>(benchmark, measuring_cpu, Scenario::NO_INTERFERENCE, nr_samples, out);
+    run_energy_benchmark<T>(cfg, Scenario::NO_INTERFERENCE, out);
+  }
+}
+
+struct ScalingConfig {
+  /// Measuring CPU, which runs the first measuring thread.
+  int measuring_cpu;
+  /// Maximum number of measuring threads (0 = all PUs).
+  size_t max_threads = 0;
+  /// Name of the benchmark.
+  std::string benchmark;
+  /// Measurement duration of every step (in seconds).
+  int duration;
+  /// Subtract the clock overhead from every sample.
+  bool subtract_overhead = false;
+};
+
+/// Order PUs for a scaling run: the measuring PU first, then one PU per core
+/// (cores on the measuring package before cores on remote packages), and SMT
+/// siblings only after every core is in use.
+inline std::vector<hwloc_obj_t> find_scaling_pus(hwloc_topology_t topology, hwloc_obj_t pu) {
+  auto package = find_package(pu->parent);
+  std::vector<hwloc_obj_t> pus;
+  hwloc_obj_t other_pu = nullptr;
+  while ((other_pu = hwloc_get_next_obj_by_type(topology, HWLOC_OBJ_PU, other_pu))) {
+    if (other_pu != pu) {
+      pus.push_back(other_pu);
+    }
+  }
+  std::stable_sort(pus.begin(), pus.end(), [&package](hwloc_obj_t a, hwloc_obj_t b) {
+    if (a->sibling_rank != b->sibling_rank) {
+      return a->sibling_rank < b->sibling_rank;
+    }
+    return (find_package(a->parent) == package) > (find_package(b->parent) == package);
+  });
+  pus.insert(pus.begin(), pu);
+  return pus;
+}
+
+/// Thread counts of a scaling run: powers of two up to @max_threads, and
+/// @max_threads itself.
+inline std::vector<size_t> scaling_steps(size_t max_threads) {
+  std::vector<size_t> steps;
+  for (size_t nr_threads = 1; nr_threads < max_threads; nr_threads *= 2) {
+    steps.push_back(nr_threads);
+  }
+  steps.push_back(max_threads);
+  return steps;
+}
+
+/* Measure how an operation scales by running it concurrently on 1..N PUs
+   without interfering threads. Every step reports the aggregate throughput
+   and the latency distribution of all threads merged together.  */
+template <class Action>
+class ScalingBenchmark {
+ public:
+  void run(const ScalingConfig &cfg, std::ostream &out) {
+    hwloc_topology_t topology = shared_topology();
+    hwloc_obj_t pu = hwloc_get_obj_by_type(topology, HWLOC_OBJ_PU, cfg.measuring_cpu);
+    auto pus = find_scaling_pus(topology, pu);
+    size_t max_threads = cfg.max_threads ? std::min(cfg.max_threads, pus.size()) : pus.size();
+    {
+      Action action;
+      if (!action.supports_non_interference()) {
+        return;
+      }
+      if (!is_supported(action, cfg.benchmark)) {
+        return;
+      }
+    }
+    for (size_t nr_threads : scaling_steps(max_threads)) {
+      std::cout << "Measuring scaling for " << cfg.benchmark << " (" << nr_threads << " threads) ..." << std::endl;
+      run_step(cfg, topology, pus, nr_threads, out);
+      if (interrupted) {
+        break;
+      }
+    }
+  }
+
+ private:
+  void run_step(const ScalingConfig &cfg, hwloc_topology_t topology, const std::vector<hwloc_obj_t> &pus, size_t nr_threads, std::ostream &out) {
+    Action action;
+    sigint_fired = false;
+    ThreadVector no_interfering_threads;
+    std::vector<struct hdr_histogram *> hists(nr_threads);
+    std::vector<uint64_t> nr_samples(nr_threads);
+    std::vector<uint64_t> elapsed(nr_threads);
+    std::atomic<size_t> nr_ready = 0;
+    std::atomic<bool> go = false;
+    uint64_t overhead = clock_overhead();
+    auto& threads = measuring_pool();
+    threads.reserve(nr_threads);
+    for (size_t tid = 0; tid < nr_threads; tid++) {
+      if (hdr_init(1, INT64_C(3600000000), 3, &hists[tid])) {
+        assert(0);
+      }
+      threads.submit(tid, [&, tid]() {
+        hwloc_set_cpubind(topology, pus[tid]->cpuset, HWLOC_CPUBIND_THREAD);
+        auto state = action.make_state(no_interfering_threads);
+        nr_ready++;
+        while (!go.load()) {
+          std::this_thread::yield();
+        }
+        /* Count in locals and store the results once, so that the threads
+           do not write to the same cache lines while they are measured.  */
+        struct hdr_histogram *hist = hists[tid];
+        uint64_t samples = 0;
+        uint64_t start = MonotonicClock::now();
+        while (!sigint_fired && !alarm_fired) {
+          auto diff = action.measured_operation(state);
+          if (cfg.subtract_overhead) {
+            diff = diff > overhead ? diff - overhead : 0;
+          }
+          samples++;
+          assert(hdr_record_value(hist, diff));
+        }
+        elapsed[tid] = MonotonicClock::now() - start;
+        nr_samples[tid] = samples;
+      });
+    }
+    while (nr_ready.load() != nr_threads) {
+      std::this_thread::yield();
+    }
+    alarm_fired = false;
+    ::alarm(cfg.duration);
+    go.store(true);
+    for (size_t tid = 0; tid < nr_threads; tid++) {
+      threads.wait(tid);
+    }
+
+    struct hdr_histogram *hist;
+    if (hdr_init(1, INT64_C(3600000000), 3, &hist)) {
+      assert(0);
+    }
+    uint64_t total_samples = 0;
+    double ops_per_sec = 0;
+    double sum_squares = 0;
+    for (size_t tid = 0; tid < nr_threads; tid++) {
+      hdr_add(hist, hists[tid]);
+      hdr_close(hists[tid]);
+      total_samples += nr_samples[tid];
+      double thread_ops_per_sec = double(nr_samples[tid]) * 1e9 / double(elapsed[tid]);
+      ops_per_sec += thread_ops_per_sec;
+      sum_squares += thread_ops_per_sec * thread_ops_per_sec;
+    }
+    /* Jain's fairness index of the per-thread throughput, which is 1 if all
+       threads completed operations at the same rate and 1/N if one thread
+       completed all of them.  */
+    double fairness = sum_squares ? ops_per_sec * ops_per_sec / (double(nr_threads) * sum_squares) : 0;
+    out << nr_threads;
+    out << ",";
+    out << total_samples;
+    out << ",";
+    out << ops_per_sec;
+    out << ",";
+    out << hdr_mean(hist);
+    out << ",";
+    out << hdr_stddev(hist);
+    for (double percentile : {50.0, 90.0, 99.0, 99.9, 99.99, 100.0}) {
+      out << ",";
+      out << hdr_value_at_percentile(hist, percentile);
+    }
+    out << ",";
+    out << fairness;
+    out << std::endl;
+    hdr_close(hist);
   }
+};
+
+template <typename T>
+static void run_scaling_benchmark(const ScalingConfig &cfg, std::ostream &out) {
+  out << "threads,samples,ops_per_sec,mean,stddev,p50,p90,p99,p99.9,p99.99,max,fairness" << std::endl;
+  ScalingBenchmark<T> bench;
+  bench.run(cfg, out);
 }
 
 static Interference parse_interference(const std::string& raw_interference)
@@ -587,77 +1945,445 @@ static Interference parse_interference(const std::string& raw_interference)
   }
 }
 
-template <typename T>
-static void run_all(int argc, char *argv[], std::optional<std::function<void(size_t)>> init = std::nullopt) {
-  /* Set up a signal handler that does not restart system calls. When
-     the user or the benchmark harness is wants to stop, they send a
-     signal to all intefering threads to return from any blocking system
-     calls.  */
-  struct ::sigaction sa_int;
-  sa_int.sa_handler = signal_handler;
-  sa_int.sa_flags = 0;
-  ::sigemptyset(&sa_int.sa_mask);
-  ::sigaction(SIGINT, &sa_int, nullptr);
-     
-  struct ::sigaction sa_alrm;
-  sa_alrm.sa_handler = alarm_signal_handler;
-  sa_alrm.sa_flags = 0;
-  ::sigemptyset(&sa_alrm.sa_mask);
-  ::sigaction(SIGALRM, &sa_alrm, nullptr);
+static Placement parse_placement(const std::string& raw_placement, std::string& cpulist)
+{
+  if (raw_placement == "spread") {
+    return Placement::SPREAD;
+  } else if (raw_placement == "package") {
+    return Placement::PACKAGE;
+  } else if (raw_placement == "smt") {
+    return Placement::SMT;
+  } else if (!raw_placement.empty() && isdigit(raw_placement[0])) {
+    cpulist = raw_placement;
+    return Placement::SPREAD;
+  } else {
+    throw std::invalid_argument("unknown '" + raw_placement + "' placement option");
+  }
+}
 
-  std::string program = ::basename(argv[0]);
+static Arrival parse_arrival(const std::string& raw_arrival)
+{
+  if (raw_arrival == "fixed") {
+    return Arrival::FIXED;
+  } else if (raw_arrival == "poisson") {
+    return Arrival::POISSON;
+  } else {
+    throw std::invalid_argument("unknown '" + raw_arrival + "' arrival option");
+  }
+}
+
+static double parse_arrival_rate(const std::string& raw_rate)
+{
+  double rate = strtod(raw_rate.c_str(), nullptr);
+  if (!(rate > 0)) {
+    throw std::invalid_argument("invalid '" + raw_rate + "' arrival rate");
+  }
+  return rate;
+}
+
+static size_t parse_batch_size(const std::string& raw_batch)
+{
+  size_t batch_size = strtoul(raw_batch.c_str(), nullptr, 10);
+  if (!batch_size) {
+    throw std::invalid_argument("invalid '" + raw_batch + "' batch size");
+  }
+  return batch_size;
+}
+
+/// Command line options shared by all benchmarks.
+struct Options {
   int measuring_cpu = 0;
   std::string raw_interference = "all";
   std::optional<std::string> latency_output;
   std::optional<int> duration;
   std::optional<std::string> energy_output;
   std::optional<int> nr_samples;
+  std::string raw_clock = "monotonic";
+  bool subtract_overhead = false;
+  std::optional<std::string> raw_batch;
+  std::optional<std::string> batch_output;
+  std::optional<std::string> counter_output;
+  std::optional<std::string> raw_rate;
+  std::string raw_arrival = "fixed";
+  std::optional<std::string> service_output;
+  std::optional<std::string> interval_output;
+  int interval_ms = DEFAULT_INTERVAL_MS;
+  std::optional<std::string> json_output;
+  std::string work_dir = ".";
+  std::optional<std::string> scaling_output;
+  size_t max_scaling_threads = 0;
+  size_t nr_interfering_threads = DEFAULT_NR_INTERFERING_THREADS;
+  std::string raw_placement = "spread";
+};
+
+/// Parse command line options. Returns false if the options are invalid.
+static bool parse_options(int argc, char *argv[], Options& opts) {
   int c;
-  while ((c = getopt(argc, argv, "m:i:l:d:e:s:")) != -1) {
+  while ((c = getopt(argc, argv, "m:i:l:d:e:s:c:Ob:B:C:r:a:S:L:I:j:w:t:k:n:P:")) != -1) {
     switch (c) {
       case 'm':
-        measuring_cpu = strtol(optarg, nullptr, 10);
+        opts.measuring_cpu = strtol(optarg, nullptr, 10);
         break;
       case 'i':
-        raw_interference = optarg;
+        opts.raw_interference = optarg;
         break;
       case 'l':
-        latency_output = optarg;
+        opts.latency_output = optarg;
         break;
       case 'd':
-        duration = strtol(optarg, nullptr, 10);
+        opts.duration = strtol(optarg, nullptr, 10);
         break;
       case 'e':
-        energy_output = optarg;
+        opts.energy_output = optarg;
         break;
       case 's':
-        nr_samples = strtol(optarg, nullptr, 10);
+        opts.nr_samples = strtol(optarg, nullptr, 10);
+        break;
+      case 'c':
+        opts.raw_clock = optarg;
+        break;
+      case 'O':
+        opts.subtract_overhead = true;
+        break;
+      case 'b':
+        opts.raw_batch = optarg;
+        break;
+      case 'B':
+        opts.batch_output = optarg;
+        break;
+      case 'C':
+        opts.counter_output = optarg;
+        break;
+      case 'r':
+        opts.raw_rate = optarg;
+        break;
+      case 'a':
+        opts.raw_arrival = optarg;
+        break;
+      case 'S':
+        opts.service_output = optarg;
+        break;
+      case 'L':
+        opts.interval_output = optarg;
+        break;
+      case 'I':
+        opts.interval_ms = std::max(1, atoi(optarg));
+        break;
+      case 'j':
+        opts.json_output = optarg;
+        break;
+      case 'w':
+        opts.work_dir = optarg;
+        break;
+      case 't':
+        opts.scaling_output = optarg;
+        break;
+      case 'k':
+        opts.max_scaling_threads = strtoul(optarg, nullptr, 10);
+        break;
+      case 'n':
+        opts.nr_interfering_threads = std::max<size_t>(1, strtoul(optarg, nullptr, 10));
+        break;
+      case 'P':
+        opts.raw_placement = optarg;
         break;
       default:
-        usage(program);
-        exit(1);
+        return false;
     }
   }
+  return true;
+}
+
+/// Replace output directories with the output files of @benchmark.
+static Options output_files(Options opts, const std::string& benchmark) {
+  auto resolve = [&benchmark](std::optional<std::string>& output, const char *suffix) {
+    if (output) {
+      *output = *output + "/" + benchmark + suffix;
+    }
+  };
+  resolve(opts.latency_output, ".csv");
+  resolve(opts.energy_output, "-energy.csv");
+  resolve(opts.batch_output, "-batch.csv");
+  resolve(opts.counter_output, "-counters.csv");
+  resolve(opts.service_output, "-service.csv");
+  resolve(opts.interval_output, "-intervals.hlog");
+  resolve(opts.json_output, ".json");
+  resolve(opts.scaling_output, "-scaling.csv");
+  return opts;
+}
+
+/// Set up signal handlers that do not restart system calls. When the user or
+/// the benchmark harness wants to stop, they send a signal to all interfering
+/// threads to return from any blocking system calls.
+static void install_signal_handlers() {
+  struct ::sigaction sa_int;
+  sa_int.sa_sigaction = signal_handler;
+  sa_int.sa_flags = SA_SIGINFO;
+  ::sigemptyset(&sa_int.sa_mask);
+  ::sigaction(SIGINT, &sa_int, nullptr);
+
+  struct ::sigaction sa_alrm;
+  sa_alrm.sa_handler = alarm_signal_handler;
+  sa_alrm.sa_flags = 0;
+  ::sigemptyset(&sa_alrm.sa_mask);
+  ::sigaction(SIGALRM, &sa_alrm, nullptr);
+}
+
+using InitFunction = std::function<void(size_t)>;
+
+template <typename T>
+static void run_benchmark(const std::string& benchmark, const Options& opts, std::optional<InitFunction> init = std::nullopt) {
   if (init) {
-    (*init)(DEFAULT_NR_INTERFERING_THREADS);
+    (*init)(opts.nr_interfering_threads);
   }
+  work_dir = opts.work_dir;
   try {
-    auto interference = parse_interference(raw_interference); 
-    if (latency_output) {
+    auto interference = parse_interference(opts.raw_interference); 
+    clock_source = parse_clock_source(opts.raw_clock);
+    std::string cpulist;
+    auto placement = parse_placement(opts.raw_placement, cpulist);
+    clock_calibrate();
+    if (opts.latency_output) {
       constexpr int DEFAULT_DURATION = 30;
+      Config cfg;
+      cfg.measuring_cpu = opts.measuring_cpu;
+      cfg.benchmark = benchmark;
+      cfg.nr_interfering_threads = opts.nr_interfering_threads;
+      cfg.placement = placement;
+      cfg.cpulist = cpulist;
+      cfg.duration = opts.duration.value_or(DEFAULT_DURATION);
+      cfg.subtract_overhead = opts.subtract_overhead;
+      if (opts.raw_batch) {
+        cfg.auto_batch = *opts.raw_batch == "auto";
+        cfg.batch_size = cfg.auto_batch ? 0 : parse_batch_size(*opts.raw_batch);
+      }
+      if (opts.raw_rate) {
+        if (opts.raw_batch) {
+          throw std::invalid_argument("open-loop mode does not support batching");
+        }
+        cfg.arrival = parse_arrival(opts.raw_arrival);
+        cfg.arrival_rate = parse_arrival_rate(*opts.raw_rate);
+      }
       std::ofstream output;
-      output.open(*latency_output);
-      run_latency_benchmarks<T>(program, measuring_cpu, interference, duration.value_or(DEFAULT_DURATION), output);
+      output.open(*opts.latency_output);
+      std::ofstream batch;
+      if (opts.raw_batch && opts.batch_output) {
+        batch.open(*opts.batch_output);
+      }
+      std::ofstream counters;
+      if (opts.counter_output) {
+        counters.open(*opts.counter_output);
+      }
+      std::ofstream service;
+      if (opts.raw_rate && opts.service_output) {
+        service.open(*opts.service_output);
+      }
+      cfg.interval = std::chrono::milliseconds(opts.interval_ms);
+      std::unique_ptr<FILE, int (*)(FILE *)> intervals(nullptr, ::fclose);
+      if (opts.interval_output) {
+        intervals.reset(::fopen(opts.interval_output->c_str(), "w"));
+        if (!intervals) {
+          throw std::system_error(errno, std::generic_category(), *opts.interval_output);
+        }
+        struct hdr_log_writer writer;
+        hdr_log_writer_init(&writer);
+        hdr_timespec now;
+        ::clock_gettime(CLOCK_REALTIME, &now);
+        hdr_log_write_header(&writer, intervals.get(), benchmark.c_str(), &now);
+      }
+      std::ofstream json_output;
+      std::optional<JsonWriter> json;
+      if (opts.json_output) {
+        json_output.open(*opts.json_output);
+        json.emplace(json_output);
+        json->begin_object();
+        json->field("benchmark", benchmark);
+        json->field("timestamp", int64_t(::time(nullptr)));
+        write_host_metadata(*json, shared_topology());
+        json->key("config");
+        json->begin_object();
+        json->field("measuring_cpu", cfg.measuring_cpu);
+        json->field("interference", opts.raw_interference);
+        json->field("interfering_threads", cfg.nr_interfering_threads);
+        json->field("placement", opts.raw_placement);
+        json->field("duration", cfg.duration);
+        json->field("clock", opts.raw_clock);
+        json->field("work_dir", opts.work_dir);
+        json->field("subtract_overhead", cfg.subtract_overhead);
+        if (opts.raw_batch) {
+          json->field("batch", *opts.raw_batch);
+        }
+        if (opts.raw_rate) {
+          json->field("arrival", opts.raw_arrival);
+          json->field("rate", cfg.arrival_rate);
+        }
+        json->end_object();
+        json->key("scenarios");
+        json->begin_array();
+      }
+      run_latency_benchmarks<T>(cfg, interference, {output, batch.is_open() ? &batch : nullptr, counters.is_open() ? &counters : nullptr, service.is_open() ? &service : nullptr, intervals.get(), json ? &*json : nullptr});
+      if (json) {
+        json->end_array();
+        json->end_object();
+        json_output << std::endl;
+      }
     }
-    if (energy_output) {
+    if (opts.energy_output) {
       constexpr int DEFAULT_NR_SAMPLES = 30;
+      EnergyConfig cfg;
+      cfg.measuring_cpu = opts.measuring_cpu;
+      cfg.nr_interfering_threads = opts.nr_interfering_threads;
+      cfg.placement = placement;
+      cfg.cpulist = cpulist;
+      cfg.benchmark = benchmark;
+      cfg.nr_samples = opts.nr_samples.value_or(DEFAULT_NR_SAMPLES);
+      std::ofstream output;
+      output.open(*opts.energy_output);
+      run_energy_benchmarks<T>(cfg, interference, output);
+    }
+    if (opts.scaling_output) {
+      constexpr int DEFAULT_DURATION = 10;
+      ScalingConfig cfg;
+      cfg.measuring_cpu = opts.measuring_cpu;
+      cfg.max_threads = opts.max_scaling_threads;
+      cfg.benchmark = benchmark;
+      cfg.duration = opts.duration.value_or(DEFAULT_DURATION);
+      cfg.subtract_overhead = opts.subtract_overhead;
       std::ofstream output;
-      output.open(*energy_output);
-      run_energy_benchmarks<T>(program, measuring_cpu, interference, nr_samples.value_or(DEFAULT_NR_SAMPLES), output);
+      output.open(*opts.scaling_output);
+      run_scaling_benchmark<T>(cfg, output);
     }
   } catch (const std::exception& e) {
     std::cerr << "error: " << e.what() << std::endl;
   }
 }
 
+template <typename T>
+static void run_all(int argc, char *argv[], std::optional<InitFunction> init = std::nullopt) {
+  install_signal_handlers();
+  std::string program = ::basename(argv[0]);
+  Options opts;
+  if (!parse_options(argc, argv, opts)) {
+    usage(program);
+    exit(1);
+  }
+  run_benchmark<T>(program, opts, init);
+}
+
+struct Registration {
+  /// Name of the benchmark.
+  std::string name;
+  /// Run the benchmark with the given options.
+  std::function<void(const Options&)> run;
+};
+
+/// All benchmarks linked into the binary.
+inline std::vector<Registration>& registry() {
+  static std::vector<Registration> registrations;
+  return registrations;
+}
+
+template <typename T>
+struct Register {
+  Register(const std::string& name, std::optional<InitFunction> init = std::nullopt) {
+    registry().push_back({name, [name, init](const Options& opts) { run_benchmark<T>(name, opts, init); }});
+  }
+};
+
+#define BENCHMARK_CONCAT_(a, b) a##b
+#define BENCHMARK_CONCAT(a, b) BENCHMARK_CONCAT_(a, b)
+
+/// Strip the parentheses around a macro argument that names a type, so that
+/// types with commas (e.g. template arguments) can be passed to macros.
+template <typename T>
+struct macro_type;
+
+template <typename T>
+struct macro_type<void(T)> {
+  using type = T;
+};
+
+/// Register @action as benchmark @name. An optional init function is called
+/// with the number of interfering threads before the benchmark runs. Put
+/// @action in parentheses if it contains commas.
+#define REGISTER_BENCHMARK(action, name, ...) \
+  static benchmark::Register<benchmark::macro_type<void(action)>::type> BENCHMARK_CONCAT(registration_, __COUNTER__)(name, ##__VA_ARGS__)
+
+static bool matches_any(const std::string& name, const std::vector<std::string>& patterns) {
+  for (auto& pattern : patterns) {
+    if (::fnmatch(pattern.c_str(), name.c_str(), 0) == 0) {
+      return true;
+    }
+  }
+  return patterns.empty();
+}
+
+static void driver_usage(std::string program)
+{
+  std::cout << "usage: " << program << " list [<pattern>...]" << std::endl;
+  std::cout << "       " << program << " run [<options>] [<pattern>...]" << std::endl;
+  std::cout << std::endl;
+  std::cout << "Output options name directories that receive one file per benchmark." << std::endl;
+  std::cout << std::endl;
+  usage(program + " run");
+}
+
+/* Entry point of the posixbench binary. When the binary is invoked through
+   a symlink named after a registered benchmark, it behaves like a standalone
+   benchmark program. Otherwise, it lists or runs every benchmark that
+   matches the glob patterns on the command line in one process, which
+   shares the hwloc topology and the thread pools between benchmarks.  */
+inline int main(int argc, char *argv[]) {
+  install_signal_handlers();
+  auto& registrations = registry();
+  std::sort(registrations.begin(), registrations.end(), [](const Registration& a, const Registration& b) {
+    return a.name < b.name;
+  });
+  std::string program = ::basename(argv[0]);
+  for (auto& registration : registrations) {
+    if (registration.name == program) {
+      Options opts;
+      if (!parse_options(argc, argv, opts)) {
+        usage(program);
+        return 1;
+      }
+      registration.run(opts);
+      return 0;
+    }
+  }
+  if (argc < 2) {
+    driver_usage(program);
+    return 1;
+  }
+  std::string command = argv[1];
+  if (command == "list") {
+    std::vector<std::string> patterns(argv + 2, argv + argc);
+    for (auto& registration : registrations) {
+      if (matches_any(registration.name, patterns)) {
+        std::cout << registration.name << std::endl;
+      }
+    }
+    return 0;
+  }
+  if (command != "run") {
+    driver_usage(program);
+    return 1;
+  }
+  Options opts;
+  if (!parse_options(argc - 1, argv + 1, opts)) {
+    driver_usage(program);
+    return 1;
+  }
+  std::vector<std::string> patterns(argv + 1 + optind, argv + argc);
+  for (auto& registration : registrations) {
+    if (interrupted) {
+      break;
+    }
+    if (matches_any(registration.name, patterns)) {
+      registration.run(output_files(opts, registration.name));
+    }
+  }
+  return 0;
+}
+
 }
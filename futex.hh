@@ -0,0 +1,85 @@
+#pragma once
+
+#include <linux/futex.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+
+namespace futex {
+
+/* Raw futex system calls on process-private 32-bit futex words. They return
+   the result of the system call, that is, -1 with errno set on failure.  */
+
+using Word = std::atomic<uint32_t>;
+
+static_assert(sizeof(Word) == sizeof(uint32_t));
+
+inline uint32_t *addr(Word *word) {
+  return reinterpret_cast<uint32_t *>(word);
+}
+
+inline long call(Word *word, int op, uint32_t val, const struct timespec *timeout, Word *word2, uint32_t val3) {
+  return ::syscall(SYS_futex, addr(word), op | FUTEX_PRIVATE_FLAG, val, timeout, word2 ? addr(word2) : nullptr, val3);
+}
+
+/// Sleep while *@word is @val, at most @timeout (relative) if not null.
+inline long wait(Word *word, uint32_t val, const struct timespec *timeout = nullptr) {
+  return call(word, FUTEX_WAIT, val, timeout, nullptr, 0);
+}
+
+/// Wake up at most @nr threads sleeping on @word.
+inline long wake(Word *word, int nr) {
+  return call(word, FUTEX_WAKE, nr, nullptr, nullptr, 0);
+}
+
+/// Sleep while *@word is @val until woken up by a wake_bitset() whose
+/// @bitset intersects with ours, at most until @deadline (CLOCK_MONOTONIC).
+inline long wait_bitset(Word *word, uint32_t val, uint32_t bitset, const struct timespec *deadline = nullptr) {
+  return call(word, FUTEX_WAIT_BITSET, val, deadline, nullptr, bitset);
+}
+
+inline long wake_bitset(Word *word, int nr, uint32_t bitset) {
+  return call(word, FUTEX_WAKE_BITSET, nr, nullptr, nullptr, bitset);
+}
+
+/// Wake up @nr_wake threads sleeping on @word and move up to @nr_requeue of
+/// the rest to sleep on @word2, if *@word is still @val.
+inline long cmp_requeue(Word *word, int nr_wake, int nr_requeue, Word *word2, uint32_t val) {
+  return ::syscall(SYS_futex, addr(word), FUTEX_CMP_REQUEUE | FUTEX_PRIVATE_FLAG, nr_wake, nr_requeue, addr(word2), val);
+}
+
+#ifdef __NR_futex_waitv
+/// Sleep until one of the @nr @waiters is woken up, at most until @deadline
+/// (CLOCK_MONOTONIC) if not null. Available since Linux 5.16.
+inline long waitv(struct futex_waitv *waiters, unsigned nr, const struct timespec *deadline = nullptr) {
+  return ::syscall(__NR_futex_waitv, waiters, nr, 0, deadline, CLOCK_MONOTONIC);
+}
+
+/// Return true if the kernel implements futex_waitv().
+inline bool supports_waitv() {
+  return waitv(nullptr, 0) < 0 && errno != ENOSYS;
+}
+#else
+inline bool supports_waitv() {
+  return false;
+}
+#endif
+
+/// Return the CLOCK_MONOTONIC time @ms milliseconds from now.
+inline struct timespec deadline_after_ms(long ms) {
+  struct timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  ts.tv_sec += ms / 1000;
+  ts.tv_nsec += (ms % 1000) * 1000000;
+  if (ts.tv_nsec >= 1000000000) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000;
+  }
+  return ts;
+}
+
+}  // namespace futex
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <linux/io_uring.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+
+namespace uring {
+
+inline int setup(unsigned entries, struct io_uring_params *params) {
+  return ::syscall(__NR_io_uring_setup, entries, params);
+}
+
+inline int enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return ::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+/// Fill in @params to set up a ring with @flags. With IORING_SETUP_SQPOLL,
+/// the kernel poller thread runs on @sq_thread_cpu if it is not negative.
+inline void init_params(struct io_uring_params *params, unsigned flags, int sq_thread_cpu, unsigned sq_thread_idle_ms) {
+  ::memset(params, 0, sizeof(*params));
+  params->flags = flags;
+  if (sq_thread_cpu >= 0) {
+    params->flags |= IORING_SETUP_SQ_AFF;
+    params->sq_thread_cpu = sq_thread_cpu;
+  }
+  params->sq_thread_idle = sq_thread_idle_ms;
+}
+
+/// Return true if a ring can be set up with @flags. io_uring can be disabled
+/// with kernel.io_uring_disabled or by a seccomp filter, and SQPOLL can be
+/// refused to unprivileged processes.
+inline bool supported(unsigned flags = 0, int sq_thread_cpu = -1) {
+  struct io_uring_params params;
+  init_params(&params, flags, sq_thread_cpu, 0);
+  int fd = setup(1, &params);
+  if (fd < 0) {
+    return false;
+  }
+  ::close(fd);
+  return true;
+}
+
+/* An io_uring instance that is driven through the raw system calls, so that
+   the benchmarks measure the kernel interface and not a library on top of
+   it. A ring is not thread-safe and must be used by one thread at a time.
+   Benchmarks check supported() before they set up a ring, so a failing
+   system call is a bug.  */
+class Ring {
+  int _fd = -1;
+  struct io_uring_params _params;
+  void *_sq_ring = MAP_FAILED;
+  size_t _sq_ring_len = 0;
+  void *_cq_ring = MAP_FAILED;
+  size_t _cq_ring_len = 0;
+  struct io_uring_sqe *_sqes = static_cast<struct io_uring_sqe *>(MAP_FAILED);
+  size_t _sqes_len = 0;
+  unsigned *_sq_head;
+  unsigned *_sq_tail;
+  unsigned *_sq_mask;
+  unsigned *_sq_flags;
+  unsigned *_sq_array;
+  unsigned *_cq_head;
+  unsigned *_cq_tail;
+  unsigned *_cq_mask;
+  struct io_uring_cqe *_cqes;
+  /// SQEs that are filled in but not yet visible to the kernel.
+  unsigned _nr_pending = 0;
+
+ public:
+  /// Set up a ring with @entries SQEs. With IORING_SETUP_SQPOLL, the kernel
+  /// poller thread runs on @sq_thread_cpu if it is not negative and goes to
+  /// sleep after @sq_thread_idle_ms of inactivity.
+  explicit Ring(unsigned entries, unsigned flags = 0, int sq_thread_cpu = -1, unsigned sq_thread_idle_ms = 0) {
+    init_params(&_params, flags, sq_thread_cpu, sq_thread_idle_ms);
+    _fd = setup(entries, &_params);
+    if (_fd < 0) {
+      assert(0);
+    }
+    _sq_ring_len = _params.sq_off.array + _params.sq_entries * sizeof(unsigned);
+    _cq_ring_len = _params.cq_off.cqes + _params.cq_entries * sizeof(struct io_uring_cqe);
+    if (_params.features & IORING_FEAT_SINGLE_MMAP) {
+      _sq_ring_len = _cq_ring_len = std::max(_sq_ring_len, _cq_ring_len);
+    }
+    _sq_ring = ::mmap(nullptr, _sq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    if (_sq_ring == MAP_FAILED) {
+      assert(0);
+    }
+    if (_params.features & IORING_FEAT_SINGLE_MMAP) {
+      _cq_ring = _sq_ring;
+    } else {
+      _cq_ring = ::mmap(nullptr, _cq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+      if (_cq_ring == MAP_FAILED) {
+        assert(0);
+      }
+    }
+    _sqes_len = _params.sq_entries * sizeof(struct io_uring_sqe);
+    _sqes = static_cast<struct io_uring_sqe *>(::mmap(nullptr, _sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES));
+    if (_sqes == MAP_FAILED) {
+      assert(0);
+    }
+    char *sq = static_cast<char *>(_sq_ring);
+    _sq_head = reinterpret_cast<unsigned *>(sq + _params.sq_off.head);
+    _sq_tail = reinterpret_cast<unsigned *>(sq + _params.sq_off.tail);
+    _sq_mask = reinterpret_cast<unsigned *>(sq + _params.sq_off.ring_mask);
+    _sq_flags = reinterpret_cast<unsigned *>(sq + _params.sq_off.flags);
+    _sq_array = reinterpret_cast<unsigned *>(sq + _params.sq_off.array);
+    char *cq = static_cast<char *>(_cq_ring);
+    _cq_head = reinterpret_cast<unsigned *>(cq + _params.cq_off.head);
+    _cq_tail = reinterpret_cast<unsigned *>(cq + _params.cq_off.tail);
+    _cq_mask = reinterpret_cast<unsigned *>(cq + _params.cq_off.ring_mask);
+    _cqes = reinterpret_cast<struct io_uring_cqe *>(cq + _params.cq_off.cqes);
+  }
+
+  ~Ring() { release(); }
+
+  Ring(const Ring&) = delete;
+  Ring& operator=(const Ring&) = delete;
+
+  bool sqpoll() const { return _params.flags & IORING_SETUP_SQPOLL; }
+
+  /// Get a zeroed SQE to fill in. The SQE is submitted by the next submit().
+  struct io_uring_sqe *get_sqe() {
+    unsigned tail = *_sq_tail + _nr_pending;
+    unsigned head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+    if (tail - head >= _params.sq_entries) {
+      return nullptr;
+    }
+    unsigned idx = tail & *_sq_mask;
+    struct io_uring_sqe *sqe = &_sqes[idx];
+    ::memset(sqe, 0, sizeof(*sqe));
+    _sq_array[idx] = idx;
+    _nr_pending++;
+    return sqe;
+  }
+
+  /// Submit the pending SQEs and wait until at least @wait_nr completions
+  /// are available. With SQPOLL, the poller thread picks up the SQEs and no
+  /// system call is made unless the poller went to sleep.
+  void submit(unsigned wait_nr = 0) {
+    unsigned nr_submit = _nr_pending;
+    __atomic_store_n(_sq_tail, *_sq_tail + _nr_pending, __ATOMIC_RELEASE);
+    _nr_pending = 0;
+    if (sqpoll()) {
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+      if (__atomic_load_n(_sq_flags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP) {
+        enter_or_abort(0, 0, IORING_ENTER_SQ_WAKEUP);
+      }
+      return;
+    }
+    enter_or_abort(nr_submit, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0);
+  }
+
+  /// Wait for the next completion and return its result. With SQPOLL, the
+  /// completion queue is busy-polled.
+  int wait_cqe() {
+    for (;;) {
+      unsigned head = *_cq_head;
+      if (head != __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE)) {
+        int res = _cqes[head & *_cq_mask].res;
+        __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+        return res;
+      }
+      if (!sqpoll()) {
+        enter_or_abort(0, 1, IORING_ENTER_GETEVENTS);
+      }
+    }
+  }
+
+ private:
+  void enter_or_abort(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    while (enter(_fd, to_submit, min_complete, flags) < 0) {
+      if (errno != EINTR) {
+        assert(0);
+      }
+    }
+  }
+
+  void release() {
+    if (_sqes != MAP_FAILED) {
+      ::munmap(_sqes, _sqes_len);
+    }
+    if (_cq_ring != MAP_FAILED && _cq_ring != _sq_ring) {
+      ::munmap(_cq_ring, _cq_ring_len);
+    }
+    if (_sq_ring != MAP_FAILED) {
+      ::munmap(_sq_ring, _sq_ring_len);
+    }
+    if (_fd >= 0) {
+      ::close(_fd);
+    }
+    _sqes = static_cast<struct io_uring_sqe *>(MAP_FAILED);
+    _cq_ring = _sq_ring = MAP_FAILED;
+    _fd = -1;
+  }
+};
+
+}  // namespace uring
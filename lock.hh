@@ -0,0 +1,314 @@
+#pragma once
+
+#include "benchmark.h"
+#include "futex.hh"
+
+#include <sched.h>
+
+#include <deque>
+#include <memory>
+#include <mutex>
+
+namespace lock {
+
+/* Lock algorithms that are not in glibc. Every lock has a Handle, which is
+   the per-thread state of the algorithm (a queue node, for example), and is
+   acquired and released with it:
+
+     Handle make_handle();
+     void lock(Handle& handle);
+     void unlock(Handle& handle);
+
+   make_handle() is called concurrently by every thread that uses the lock,
+   after the thread has been bound to its PU.  */
+
+/// Test-and-test-and-set spinlock with exponential backoff.
+class Ttas {
+  static constexpr int MAX_BACKOFF = 1024;
+
+  std::atomic<bool> _locked{false};
+
+ public:
+  struct Handle {};
+
+  Handle make_handle() { return Handle{}; }
+
+  void lock(Handle& handle) {
+    int backoff = 1;
+    for (;;) {
+      while (_locked.load(std::memory_order_relaxed)) {
+        benchmark::cpu_relax();
+      }
+      if (!_locked.exchange(true, std::memory_order_acquire)) {
+        return;
+      }
+      for (int i = 0; i < backoff; i++) {
+        benchmark::cpu_relax();
+      }
+      backoff = std::min(backoff * 2, MAX_BACKOFF);
+    }
+  }
+
+  void unlock(Handle& handle) { _locked.store(false, std::memory_order_release); }
+};
+
+/// Ticket lock, which grants the lock in FIFO order.
+class Ticket {
+  std::atomic<uint32_t> _next{0};
+  std::atomic<uint32_t> _owner{0};
+
+ public:
+  struct Handle {};
+
+  Handle make_handle() { return Handle{}; }
+
+  void lock(Handle& handle) { lock(); }
+
+  void unlock(Handle& handle) { unlock(); }
+
+  void lock() {
+    uint32_t ticket = _next.fetch_add(1, std::memory_order_relaxed);
+    while (_owner.load(std::memory_order_acquire) != ticket) {
+      benchmark::cpu_relax();
+    }
+  }
+
+  void unlock() { _owner.store(_owner.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+  /// Return true if other threads wait for the lock. Call with the lock held.
+  bool has_waiters() const { return _next.load(std::memory_order_relaxed) - _owner.load(std::memory_order_relaxed) > 1; }
+};
+
+/* Queue nodes of the queue locks. The nodes outlive the threads that use
+   them, because a CLH lock hands a thread the node of its predecessor.  */
+template <typename Node>
+class NodePool {
+  std::mutex _lock;
+  std::deque<Node> _nodes;
+
+ public:
+  Node *alloc() {
+    std::lock_guard<std::mutex> guard(_lock);
+    return &_nodes.emplace_back();
+  }
+};
+
+/* MCS queue lock (Mellor-Crummey and Scott). Every waiter spins on a flag in
+   its own queue node, which its predecessor clears on release.  */
+class Mcs {
+  struct alignas(64) Node {
+    std::atomic<Node *> next{nullptr};
+    std::atomic<bool> locked{false};
+  };
+
+  std::atomic<Node *> _tail{nullptr};
+  NodePool<Node> _nodes;
+
+ public:
+  struct Handle {
+    Node *node;
+  };
+
+  Handle make_handle() { return Handle{_nodes.alloc()}; }
+
+  void lock(Handle& handle) {
+    Node *node = handle.node;
+    node->next.store(nullptr, std::memory_order_relaxed);
+    node->locked.store(true, std::memory_order_relaxed);
+    Node *pred = _tail.exchange(node, std::memory_order_acq_rel);
+    if (pred) {
+      pred->next.store(node, std::memory_order_release);
+      while (node->locked.load(std::memory_order_acquire)) {
+        benchmark::cpu_relax();
+      }
+    }
+  }
+
+  void unlock(Handle& handle) {
+    Node *node = handle.node;
+    Node *next = node->next.load(std::memory_order_acquire);
+    if (!next) {
+      Node *expected = node;
+      if (_tail.compare_exchange_strong(expected, nullptr, std::memory_order_release, std::memory_order_relaxed)) {
+        return;
+      }
+      /* A successor is linking itself in.  */
+      while (!(next = node->next.load(std::memory_order_acquire))) {
+        benchmark::cpu_relax();
+      }
+    }
+    next->locked.store(false, std::memory_order_release);
+  }
+};
+
+/* CLH queue lock (Craig, Landin and Hagersten). Every waiter spins on the
+   node of its predecessor and takes that node over when it has the lock.  */
+class Clh {
+  struct alignas(64) Node {
+    std::atomic<bool> locked{false};
+  };
+
+  NodePool<Node> _nodes;
+  std::atomic<Node *> _tail{_nodes.alloc()};
+
+ public:
+  struct Handle {
+    Node *node;
+    Node *pred;
+  };
+
+  Handle make_handle() { return Handle{_nodes.alloc(), nullptr}; }
+
+  void lock(Handle& handle) {
+    handle.node->locked.store(true, std::memory_order_relaxed);
+    handle.pred = _tail.exchange(handle.node, std::memory_order_acq_rel);
+    while (handle.pred->locked.load(std::memory_order_acquire)) {
+      benchmark::cpu_relax();
+    }
+  }
+
+  void unlock(Handle& handle) {
+    Node *node = handle.node;
+    handle.node = handle.pred;
+    node->locked.store(false, std::memory_order_release);
+  }
+};
+
+/* Futex-based mutex from "Futexes Are Tricky" (Drepper). The futex word is
+   0 if unlocked, 1 if locked, and 2 if locked and there may be waiters, so
+   that uncontended lock and unlock need no system call.  */
+class Futex {
+  futex::Word _word{0};
+
+ public:
+  struct Handle {};
+
+  Handle make_handle() { return Handle{}; }
+
+  void lock(Handle& handle) {
+    uint32_t c = 0;
+    if (_word.compare_exchange_strong(c, 1, std::memory_order_acquire)) {
+      return;
+    }
+    if (c != 2) {
+      c = _word.exchange(2, std::memory_order_acquire);
+    }
+    while (c != 0) {
+      futex::wait(&_word, 2);
+      c = _word.exchange(2, std::memory_order_acquire);
+    }
+  }
+
+  void unlock(Handle& handle) {
+    if (_word.fetch_sub(1, std::memory_order_release) != 1) {
+      _word.store(0, std::memory_order_release);
+      futex::wake(&_word, 1);
+    }
+  }
+};
+
+/* NUMA-aware cohort lock C-TKT-TKT ("Lock Cohorting", Dice, Marathe and
+   Shavit). A thread takes the ticket lock of its package and then the global
+   ticket lock. On release, it passes the global lock to a waiter of the same
+   package, up to MAX_PASSES times in a row, so that the lock and the data it
+   protects stay in one package.  */
+class Cohort {
+  static constexpr unsigned MAX_PASSES = 64;
+
+  struct alignas(64) Cluster {
+    Ticket local;
+    /// The global lock was passed on with the local lock.
+    bool global_passed = false;
+    unsigned nr_passes = 0;
+  };
+
+  Ticket _global;
+  size_t _nr_clusters;
+  std::unique_ptr<Cluster[]> _clusters;
+
+  /// Return the index of the package that the calling thread runs on.
+  size_t current_cluster() {
+    hwloc_topology_t topology = benchmark::shared_topology();
+    hwloc_obj_t pu = hwloc_get_pu_obj_by_os_index(topology, ::sched_getcpu());
+    if (!pu) {
+      return 0;
+    }
+    auto package = benchmark::find_package(pu);
+    return package ? (*package)->logical_index % _nr_clusters : 0;
+  }
+
+ public:
+  struct Handle {
+    Cluster *cluster;
+  };
+
+  Cohort()
+      : _nr_clusters{size_t(std::max(1, hwloc_get_nbobjs_by_type(benchmark::shared_topology(), HWLOC_OBJ_PACKAGE)))},
+        _clusters{new Cluster[_nr_clusters]} {}
+
+  Handle make_handle() { return Handle{&_clusters[current_cluster()]}; }
+
+  void lock(Handle& handle) {
+    Cluster& cluster = *handle.cluster;
+    cluster.local.lock();
+    if (!cluster.global_passed) {
+      _global.lock();
+    }
+  }
+
+  void unlock(Handle& handle) {
+    Cluster& cluster = *handle.cluster;
+    if (cluster.local.has_waiters() && ++cluster.nr_passes < MAX_PASSES) {
+      cluster.global_passed = true;
+    } else {
+      cluster.global_passed = false;
+      cluster.nr_passes = 0;
+      _global.unlock();
+    }
+    cluster.local.unlock();
+  }
+};
+
+/* Sequence lock, whose readers do not write to shared memory. A reader
+   retries if a writer updated the data while it was reading. Writers are
+   serialized with a ticket lock.  */
+template <size_t NR_WORDS>
+class SeqLock {
+  std::atomic<uint32_t> _seq{0};
+  std::atomic<uint64_t> _data[NR_WORDS] = {};
+  Ticket _writer;
+
+ public:
+  /// Copy the data to @out.
+  void read(uint64_t *out) {
+    for (;;) {
+      uint32_t seq = _seq.load(std::memory_order_acquire);
+      if (seq & 1) {
+        benchmark::cpu_relax();
+        continue;
+      }
+      for (size_t i = 0; i < NR_WORDS; i++) {
+        out[i] = _data[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (_seq.load(std::memory_order_relaxed) == seq) {
+        return;
+      }
+    }
+  }
+
+  /// Set every word of the data to @value.
+  void write(uint64_t value) {
+    _writer.lock();
+    uint32_t seq = _seq.load(std::memory_order_relaxed);
+    _seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < NR_WORDS; i++) {
+      _data[i].store(value, std::memory_order_relaxed);
+    }
+    _seq.store(seq + 2, std::memory_order_release);
+    _writer.unlock();
+  }
+};
+
+}  // namespace lock
@@ -8,4 +8,10 @@ inline T force_read(volatile T *addr) {
   return *addr;
 }
 
+/// Force a write of @value to memory location @addr.
+template <typename T>
+inline void force_write(volatile T *addr, T value) {
+  *addr = value;
+}
+
 }  // namespace memory
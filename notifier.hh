@@ -0,0 +1,396 @@
+#pragma once
+
+#include "benchmark.h"
+#include "futex.hh"
+
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+#include <memory>
+#include <vector>
+
+namespace notifier {
+
+/* Notifier policies of benchmark::PingPongAction. Every interfering thread
+   has a channel of its own in both directions, so only the measuring thread
+   and one interfering thread ever use a channel.
+
+   Blocking waits in interfering threads return when the benchmark harness
+   interrupts them with a signal at the end of a measurement. Waits that can
+   time out do so after wait_timeout_ms, so that they do not depend on the
+   signal arriving while the thread is blocked.  */
+
+static constexpr long wait_timeout_ms = 100;
+
+inline bool interrupted_or_timed_out(int err) {
+  return err == EINTR || err == EAGAIN || err == ETIMEDOUT;
+}
+
+/// Notification by writing a byte to a pipe.
+class Pipe {
+  std::vector<std::array<int, 2>> _to_remote;
+  std::vector<std::array<int, 2>> _to_local;
+
+  static void write_byte(int fd) {
+    char c = 0;
+    if (::write(fd, &c, 1) != 1) {
+      assert(0);
+    }
+  }
+
+ public:
+  explicit Pipe(size_t nr_remote_threads) : _to_remote(nr_remote_threads), _to_local(nr_remote_threads) {
+    for (size_t i = 0; i < nr_remote_threads; i++) {
+      if (::pipe(_to_remote[i].data()) < 0 || ::pipe(_to_local[i].data()) < 0) {
+        assert(0);
+      }
+    }
+  }
+
+  ~Pipe() {
+    for (size_t i = 0; i < _to_remote.size(); i++) {
+      for (int fd : {_to_remote[i][0], _to_remote[i][1], _to_local[i][0], _to_local[i][1]}) {
+        ::close(fd);
+      }
+    }
+  }
+
+  void notify_remote(const benchmark::ThreadVector& ts, size_t tid) { write_byte(_to_remote[tid][1]); }
+
+  bool wait_remote(size_t tid) {
+    char c;
+    if (::read(_to_remote[tid][0], &c, 1) != 1) {
+      if (errno == EINTR) {
+        return false;
+      }
+      assert(0);
+    }
+    return true;
+  }
+
+  void notify_local(size_t tid) { write_byte(_to_local[tid][1]); }
+
+  void wait_local(size_t tid) {
+    char c;
+    while (::read(_to_local[tid][0], &c, 1) != 1) {
+      if (errno != EINTR) {
+        assert(0);
+      }
+    }
+  }
+};
+
+/* Notification by writing to an eventfd. With NONBLOCK, interfering threads
+   busy-poll their eventfd instead of sleeping on it.  */
+template <bool NONBLOCK>
+class Eventfd {
+  std::vector<int> _to_remote;
+  std::vector<int> _to_local;
+
+ public:
+  explicit Eventfd(size_t nr_remote_threads) {
+    for (size_t i = 0; i < nr_remote_threads; i++) {
+      _to_remote.push_back(::eventfd(0, NONBLOCK ? EFD_NONBLOCK : 0));
+      _to_local.push_back(::eventfd(0, 0));
+      if (_to_remote.back() < 0 || _to_local.back() < 0) {
+        assert(0);
+      }
+    }
+  }
+
+  ~Eventfd() {
+    for (size_t i = 0; i < _to_remote.size(); i++) {
+      ::close(_to_remote[i]);
+      ::close(_to_local[i]);
+    }
+  }
+
+  void notify_remote(const benchmark::ThreadVector& ts, size_t tid) {
+    if (::eventfd_write(_to_remote[tid], 1) < 0) {
+      assert(0);
+    }
+  }
+
+  bool wait_remote(size_t tid) {
+    eventfd_t value;
+    if (::eventfd_read(_to_remote[tid], &value) < 0) {
+      if (errno == EAGAIN || errno == EINTR) {
+        return false;
+      }
+      assert(0);
+    }
+    return true;
+  }
+
+  void notify_local(size_t tid) {
+    if (::eventfd_write(_to_local[tid], 1) < 0) {
+      assert(0);
+    }
+  }
+
+  void wait_local(size_t tid) {
+    eventfd_t value;
+    while (::eventfd_read(_to_local[tid], &value) < 0) {
+      if (errno != EINTR) {
+        assert(0);
+      }
+    }
+  }
+};
+
+/// Notification by setting a futex word and waking up its waiter.
+class Futex {
+  struct alignas(64) Channel {
+    futex::Word to_remote{0};
+    alignas(64) futex::Word to_local{0};
+  };
+
+  std::unique_ptr<Channel[]> _channels;
+
+  static void notify(futex::Word& word) {
+    word.store(1);
+    if (futex::wake(&word, 1) < 0) {
+      assert(0);
+    }
+  }
+
+ public:
+  explicit Futex(size_t nr_remote_threads) : _channels{new Channel[nr_remote_threads]} {}
+
+  void notify_remote(const benchmark::ThreadVector& ts, size_t tid) { notify(_channels[tid].to_remote); }
+
+  bool wait_remote(size_t tid) {
+    futex::Word& word = _channels[tid].to_remote;
+    while (word.load() == 0) {
+      struct timespec timeout = {0, wait_timeout_ms * 1000000};
+      if (futex::wait(&word, 0, &timeout) < 0 && errno != EAGAIN) {
+        if (interrupted_or_timed_out(errno)) {
+          return false;
+        }
+        assert(0);
+      }
+    }
+    word.store(0);
+    return true;
+  }
+
+  void notify_local(size_t tid) { notify(_channels[tid].to_local); }
+
+  void wait_local(size_t tid) {
+    futex::Word& word = _channels[tid].to_local;
+    while (word.load() == 0) {
+      if (futex::wait(&word, 0) < 0 && errno != EAGAIN && errno != EINTR) {
+        assert(0);
+      }
+    }
+    word.store(0);
+  }
+};
+
+/// Notification by setting a flag under a mutex and signaling a condition
+/// variable.
+class Condvar {
+  struct alignas(64) Channel {
+    std::mutex lock;
+    std::condition_variable to_remote_cond;
+    std::condition_variable to_local_cond;
+    bool to_remote = false;
+    bool to_local = false;
+  };
+
+  std::unique_ptr<Channel[]> _channels;
+
+ public:
+  explicit Condvar(size_t nr_remote_threads) : _channels{new Channel[nr_remote_threads]} {}
+
+  void notify_remote(const benchmark::ThreadVector& ts, size_t tid) {
+    Channel& ch = _channels[tid];
+    std::lock_guard<std::mutex> guard(ch.lock);
+    ch.to_remote = true;
+    ch.to_remote_cond.notify_one();
+  }
+
+  bool wait_remote(size_t tid) {
+    Channel& ch = _channels[tid];
+    std::unique_lock<std::mutex> guard(ch.lock);
+    if (!ch.to_remote_cond.wait_for(guard, std::chrono::milliseconds(wait_timeout_ms), [&ch] { return ch.to_remote; })) {
+      return false;
+    }
+    ch.to_remote = false;
+    return true;
+  }
+
+  void notify_local(size_t tid) {
+    Channel& ch = _channels[tid];
+    std::lock_guard<std::mutex> guard(ch.lock);
+    ch.to_local = true;
+    ch.to_local_cond.notify_one();
+  }
+
+  void wait_local(size_t tid) {
+    Channel& ch = _channels[tid];
+    std::unique_lock<std::mutex> guard(ch.lock);
+    ch.to_local_cond.wait(guard, [&ch] { return ch.to_local; });
+    ch.to_local = false;
+  }
+};
+
+/* Notification by a queued real-time signal, which the receiving thread
+   accepts synchronously with sigtimedwait(). The signals must be blocked in
+   all threads, see block_signals().  */
+class Signal {
+  static int to_remote_signal() { return SIGRTMIN + 0; }
+  static int to_local_signal() { return SIGRTMIN + 1; }
+
+  pthread_t _local;
+
+  static void send(pthread_t thread, int signo) {
+    union sigval value = {};
+    if (::pthread_sigqueue(thread, signo, value) != 0) {
+      assert(0);
+    }
+  }
+
+ public:
+  explicit Signal(size_t nr_remote_threads) {}
+
+  /// Block the notification signals in the calling thread, whose signal mask
+  /// the benchmark threads take. Call from the init function.
+  static void block_signals() {
+    ::sigset_t set;
+    ::sigemptyset(&set);
+    ::sigaddset(&set, to_remote_signal());
+    ::sigaddset(&set, to_local_signal());
+    if (::pthread_sigmask(SIG_BLOCK, &set, nullptr) != 0) {
+      assert(0);
+    }
+  }
+
+  void notify_remote(const benchmark::ThreadVector& ts, size_t tid) {
+    _local = ::pthread_self();
+    send(const_cast<std::thread&>(ts[tid]).native_handle(), to_remote_signal());
+  }
+
+  bool wait_remote(size_t tid) {
+    ::sigset_t set;
+    ::sigemptyset(&set);
+    ::sigaddset(&set, to_remote_signal());
+    struct timespec timeout = {0, wait_timeout_ms * 1000000};
+    if (::sigtimedwait(&set, nullptr, &timeout) < 0) {
+      if (interrupted_or_timed_out(errno)) {
+        return false;
+      }
+      assert(0);
+    }
+    return true;
+  }
+
+  void notify_local(size_t tid) { send(_local, to_local_signal()); }
+
+  void wait_local(size_t tid) {
+    ::sigset_t set;
+    ::sigemptyset(&set);
+    ::sigaddset(&set, to_local_signal());
+    while (::sigwaitinfo(&set, nullptr) < 0) {
+      if (errno != EINTR) {
+        assert(0);
+      }
+    }
+  }
+};
+
+/// Notification by sending a datagram over an AF_UNIX socket pair.
+class UnixDgram {
+  std::vector<std::array<int, 2>> _sockets;
+
+  static void send_byte(int fd) {
+    char c = 0;
+    if (::send(fd, &c, 1, 0) != 1) {
+      assert(0);
+    }
+  }
+
+ public:
+  explicit UnixDgram(size_t nr_remote_threads) : _sockets(nr_remote_threads) {
+    for (size_t i = 0; i < nr_remote_threads; i++) {
+      if (::socketpair(AF_UNIX, SOCK_DGRAM, 0, _sockets[i].data()) < 0) {
+        assert(0);
+      }
+      struct timeval timeout = {0, wait_timeout_ms * 1000};
+      if (::setsockopt(_sockets[i][1], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
+        assert(0);
+      }
+    }
+  }
+
+  ~UnixDgram() {
+    for (auto& sv : _sockets) {
+      ::close(sv[0]);
+      ::close(sv[1]);
+    }
+  }
+
+  void notify_remote(const benchmark::ThreadVector& ts, size_t tid) { send_byte(_sockets[tid][0]); }
+
+  bool wait_remote(size_t tid) {
+    char c;
+    if (::recv(_sockets[tid][1], &c, 1, 0) != 1) {
+      if (interrupted_or_timed_out(errno)) {
+        return false;
+      }
+      assert(0);
+    }
+    return true;
+  }
+
+  void notify_local(size_t tid) { send_byte(_sockets[tid][1]); }
+
+  void wait_local(size_t tid) {
+    char c;
+    while (::recv(_sockets[tid][0], &c, 1, 0) != 1) {
+      if (errno != EINTR) {
+        assert(0);
+      }
+    }
+  }
+};
+
+/* Notification by setting a flag in shared memory that the other thread
+   busy-polls. This is the floor of the cross-thread notification latency,
+   which is the cost of moving a cache line between the two PUs.  */
+class Spin {
+  struct alignas(64) Channel {
+    std::atomic<bool> to_remote{false};
+    alignas(64) std::atomic<bool> to_local{false};
+  };
+
+  std::unique_ptr<Channel[]> _channels;
+
+ public:
+  explicit Spin(size_t nr_remote_threads) : _channels{new Channel[nr_remote_threads]} {}
+
+  void notify_remote(const benchmark::ThreadVector& ts, size_t tid) { _channels[tid].to_remote.store(true, std::memory_order_release); }
+
+  bool wait_remote(size_t tid) {
+    auto& flag = _channels[tid].to_remote;
+    if (!flag.load(std::memory_order_acquire)) {
+      return false;
+    }
+    flag.store(false, std::memory_order_relaxed);
+    return true;
+  }
+
+  void notify_local(size_t tid) { _channels[tid].to_local.store(true, std::memory_order_release); }
+
+  void wait_local(size_t tid) {
+    auto& flag = _channels[tid].to_local;
+    while (!flag.load(std::memory_order_acquire)) {
+    }
+    flag.store(false, std::memory_order_relaxed);
+  }
+};
+
+}  // namespace notifier
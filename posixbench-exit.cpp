@@ -0,0 +1,7 @@
+/* Helper program that exits immediately. The process benchmarks spawn and
+   exec it, so it is linked statically where possible to keep the dynamic
+   loader out of the measurement.  */
+
+int main() {
+  return 0;
+}
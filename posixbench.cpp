@@ -0,0 +1,3 @@
+#include "benchmark.h"
+
+int main(int argc, char *argv[]) { return benchmark::main(argc, argv); }
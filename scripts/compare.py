@@ -0,0 +1,269 @@
+#!/usr/bin/env python3
+
+import pandas as pd
+import numpy as np
+import argparse
+import base64
+import glob
+import json
+import math
+import os
+import struct
+import sys
+import zlib
+
+parser = argparse.ArgumentParser(description='Compare two result sets and flag significant regressions.')
+parser.add_argument("base", help='The result directory to compare against.')
+parser.add_argument("new", help='The result directory to compare.')
+parser.add_argument("--threshold", type=float, default=5.0, help='Smallest slowdown (in %%) that counts as a regression.')
+parser.add_argument("--confidence", type=float, default=0.95, help='Confidence level of the bootstrap intervals, and one minus the family-wise error rate of the verdicts.')
+parser.add_argument("--resamples", type=int, default=10000, help='Number of bootstrap resamples.')
+parser.add_argument("--seed", type=int, default=0, help='Seed of the bootstrap resampling.')
+args = parser.parse_args()
+
+PERCENTILES = [50.0, 90.0, 99.0, 99.9]
+
+# Outputs that are not compared.
+IGNORED_SUFFIXES = ['-batch.csv', '-counters.csv', '-service.csv', '-scaling.csv']
+
+rng = np.random.default_rng(args.seed)
+
+# Find result files of a result directory. Repeated runs of the same benchmark
+# live in subdirectories (e.g. results/Linux/CPU/run-1/bench-getuid.csv).
+def find_results(directory):
+  latency = {}
+  energy = {}
+  histograms = {}
+  for filename in sorted(glob.glob(os.path.join(directory, '**', '*.csv'), recursive=True)):
+    basename = os.path.basename(filename)
+    if any(basename.endswith(suffix) for suffix in IGNORED_SUFFIXES):
+      continue
+    if basename.endswith('-energy.csv'):
+      energy.setdefault(basename[:-len('-energy.csv')], []).append(filename)
+    else:
+      latency.setdefault(basename[:-len('.csv')], []).append(filename)
+  for filename in sorted(glob.glob(os.path.join(directory, '**', '*.json'), recursive=True)):
+    histograms.setdefault(os.path.basename(filename)[:-len('.json')], []).append(filename)
+  return latency, energy, histograms
+
+# Read a ZigZag LEB128 varint as encoded by HdrHistogram, which uses
+# all 8 bits of the ninth byte.
+def read_varint(payload, pos):
+  value = 0
+  for i in range(9):
+    byte = payload[pos + i]
+    if i == 8:
+      value |= byte << 56
+      break
+    value |= (byte & 0x7f) << (7 * i)
+    if not byte & 0x80:
+      break
+  return (value >> 1) ^ -(value & 1), pos + i + 1
+
+# Decode a histogram encoded with hdr_log_encode() (V2 compressed format) into
+# (values, counts) of its non-empty buckets, where the value is the lowest of
+# the bucket.
+def decode_histogram(encoded):
+  data = base64.b64decode(encoded)
+  cookie, length = struct.unpack('>ii', data[:8])
+  if cookie & ~0xf0 != 0x1c849304:
+    raise ValueError('not a compressed V2 histogram')
+  payload = zlib.decompress(data[8:8 + length])
+  cookie, payload_len, _, significant_figures, lowest, _, _ = struct.unpack('>iiiiqqd', payload[:40])
+  if cookie & ~0xf0 != 0x1c849303:
+    raise ValueError('not a V2 histogram')
+  sub_bucket_count_magnitude = math.ceil(math.log2(2 * 10 ** significant_figures))
+  sub_bucket_half_count_magnitude = max(sub_bucket_count_magnitude, 1) - 1
+  sub_bucket_half_count = 1 << sub_bucket_half_count_magnitude
+  unit_magnitude = int(math.floor(math.log2(lowest)))
+  values = []
+  counts = []
+  index = 0
+  pos = 40
+  while pos < 40 + payload_len:
+    count, pos = read_varint(payload, pos)
+    if count < 0:
+      index -= count
+      continue
+    if count > 0:
+      bucket_index = (index >> sub_bucket_half_count_magnitude) - 1
+      sub_bucket_index = (index & (sub_bucket_half_count - 1)) + sub_bucket_half_count
+      if bucket_index < 0:
+        sub_bucket_index -= sub_bucket_half_count
+        bucket_index = 0
+      values.append(sub_bucket_index << (bucket_index + unit_magnitude))
+      counts.append(count)
+    index += 1
+  return np.asarray(values, dtype=float), np.asarray(counts, dtype=np.int64)
+
+# Latency histograms of the JSON outputs as {scenario: [(values, counts) per run]}.
+def load_histograms(filenames):
+  histograms = {}
+  for filename in filenames:
+    with open(filename) as f:
+      result = json.load(f)
+    for scenario in result.get('scenarios', []):
+      if scenario.get('samples') and 'histogram' in scenario:
+        histograms.setdefault(scenario['scenario'], []).append(decode_histogram(scenario['histogram']))
+  return histograms
+
+# Per-run latency percentiles as {(scenario, percentile): [value per run]}.
+def load_latency(filenames):
+  samples = {}
+  for filename in filenames:
+    df = pd.read_csv(filename, delimiter=',', header=0)
+    df['percentile'] = pd.to_numeric(df['percentile'], errors='coerce')
+    df = df.dropna()
+    for percentile in PERCENTILES:
+      rows = df.loc[np.isclose(df['percentile'], percentile)]
+      for scenario, value in zip(rows['scenario'], rows['time']):
+        samples.setdefault((scenario, percentile), []).append(float(value))
+  return samples
+
+# Per-sample duration of an operation as {scenario: [duration per sample]}.
+def load_energy(filenames):
+  samples = {}
+  for filename in filenames:
+    df = pd.read_csv(filename, delimiter=',', header=0)
+    for scenario, group in df.groupby('Scenario', sort=False):
+      samples.setdefault(scenario, []).extend(group['DurationPerOperation(ns)'].astype(float))
+  return samples
+
+# Merge the histograms of every run into (values, counts).
+def merge_histograms(histograms):
+  values = np.concatenate([values for values, _ in histograms])
+  counts = np.concatenate([counts for _, counts in histograms])
+  values, inverse = np.unique(values, return_inverse=True)
+  return values, np.bincount(inverse, weights=counts).astype(np.int64)
+
+# Value at @percentile of histograms with the same buckets and cumulative
+# counts @cumulative, one per row.
+def histogram_percentile(values, cumulative, percentile):
+  targets = np.maximum(np.ceil(cumulative[..., -1:] * percentile / 100), 1)
+  return values[np.minimum((cumulative < targets).sum(axis=-1), len(values) - 1)]
+
+# Merge the histograms of every run and resample their samples with the
+# Poisson bootstrap, which draws the count of every bucket from a Poisson
+# distribution and approximates resampling with replacement for many samples.
+# Return the values of the buckets, the cumulative counts and those of every
+# resample.
+def resample_histograms(histograms):
+  values, counts = merge_histograms(histograms)
+  resamples = rng.poisson(counts, (args.resamples, len(counts)))
+  return values, np.cumsum(counts), np.cumsum(resamples, axis=1)
+
+# Relative change from base to new (in %), its bootstrap confidence interval
+# and the two-sided bootstrap p-value of no change, given the statistic of
+# both sides and of every resample.
+def summarize(base, new, base_resamples, new_resamples):
+  delta = (new / base - 1) * 100
+  deltas = (new_resamples / base_resamples - 1) * 100
+  alpha = 1 - args.confidence
+  ci = (np.quantile(deltas, alpha / 2), np.quantile(deltas, 1 - alpha / 2))
+  tail = min(np.count_nonzero(deltas <= 0), np.count_nonzero(deltas >= 0))
+  return delta, ci, min(1.0, 2 * (tail + 1) / (len(deltas) + 1))
+
+# Compare the means of per-run or per-sample values. The interval and the
+# p-value are None if either side has only one value, because there is
+# nothing to resample.
+def compare(base, new):
+  base = np.asarray(base)
+  new = np.asarray(new)
+  if len(base) < 2 or len(new) < 2:
+    return (new.mean() / base.mean() - 1) * 100, None, None
+  base_means = rng.choice(base, (args.resamples, len(base))).mean(axis=1)
+  new_means = rng.choice(new, (args.resamples, len(new))).mean(axis=1)
+  return summarize(base.mean(), new.mean(), base_means, new_means)
+
+# Compare a percentile of the resampled latency histograms of both sides.
+def compare_histograms(base, new, percentile):
+  base_values, base_cumulative, base_resamples = base
+  new_values, new_cumulative, new_resamples = new
+  return summarize(histogram_percentile(base_values, base_cumulative, percentile),
+                   histogram_percentile(new_values, new_cumulative, percentile),
+                   histogram_percentile(base_values, base_resamples, percentile),
+                   histogram_percentile(new_values, new_resamples, percentile))
+
+# Adjust p-values for multiple comparisons with the Holm-Bonferroni method.
+def holm(pvalues):
+  order = sorted(range(len(pvalues)), key=lambda i: pvalues[i])
+  adjusted = [None] * len(pvalues)
+  running = 0.0
+  for rank, i in enumerate(order):
+    running = max(running, min(1.0, (len(pvalues) - rank) * pvalues[i]))
+    adjusted[i] = running
+  return adjusted
+
+rows = []
+
+def add_row(benchmark, scenario, metric, base, new, result):
+  delta, ci, pvalue = result
+  rows.append({
+    'benchmark': benchmark,
+    'scenario': scenario,
+    'metric': metric,
+    'base': base,
+    'new': new,
+    'delta(%)': delta,
+    'ci': 'n/a' if ci is None else '[%+.1f, %+.1f]' % ci,
+    'p(holm)': pvalue,
+  })
+
+base_latency, base_energy, base_histograms = find_results(args.base)
+new_latency, new_energy, new_histograms = find_results(args.new)
+
+# Percentiles are compared across runs if both sides have repeated runs, and
+# from the samples of the JSON histograms otherwise.
+for benchmark in sorted(set(base_latency) & set(new_latency)):
+  base = load_latency(base_latency[benchmark])
+  new = load_latency(new_latency[benchmark])
+  histograms = benchmark in base_histograms and benchmark in new_histograms
+  if histograms:
+    base_hists = load_histograms(base_histograms[benchmark])
+    new_hists = load_histograms(new_histograms[benchmark])
+  resampled = {}
+  for key in base:
+    if key in new:
+      scenario, percentile = key
+      result = compare(base[key], new[key])
+      if result[1] is None and histograms and scenario in base_hists and scenario in new_hists:
+        if scenario not in resampled:
+          resampled[scenario] = (resample_histograms(base_hists[scenario]), resample_histograms(new_hists[scenario]))
+        result = compare_histograms(*resampled[scenario], percentile)
+      add_row(benchmark, scenario, 'p%g' % percentile, np.mean(base[key]), np.mean(new[key]), result)
+
+for benchmark in sorted(set(base_energy) & set(new_energy)):
+  base = load_energy(base_energy[benchmark])
+  new = load_energy(new_energy[benchmark])
+  for scenario in base:
+    if scenario in new:
+      add_row(benchmark, scenario, 'ns/op', np.mean(base[scenario]), np.mean(new[scenario]), compare(base[scenario], new[scenario]))
+
+if not rows:
+  print("No benchmarks in common between %s and %s" % (args.base, args.new), file=sys.stderr)
+  sys.exit(2)
+
+# Every row is a test, so the verdicts use p-values that are adjusted for the
+# number of rows.
+tested = [i for i, row in enumerate(rows) if row['p(holm)'] is not None]
+if len(tested) < len(rows):
+  print("warning: %d comparisons have a single run on one side and no JSON histograms, so they cannot be tested"
+        % (len(rows) - len(tested)), file=sys.stderr)
+for i, pvalue in zip(tested, holm([rows[i]['p(holm)'] for i in tested])):
+  rows[i]['p(holm)'] = pvalue
+for row in rows:
+  significant = row['p(holm)'] is not None and row['p(holm)'] < 1 - args.confidence
+  if significant and row['delta(%)'] >= args.threshold:
+    row['verdict'] = 'REGRESSION'
+  elif significant and row['delta(%)'] < 0:
+    row['verdict'] = 'improvement'
+  else:
+    row['verdict'] = ''
+  row['p(holm)'] = 'n/a' if row['p(holm)'] is None else '%.3g' % row['p(holm)']
+
+df = pd.DataFrame(rows)
+with pd.option_context('display.max_rows', None, 'display.width', None, 'display.float_format', '{:.1f}'.format):
+  print(df.to_string(index=False))
+
+if (df['verdict'] == 'REGRESSION').any():
+  sys.exit(1)
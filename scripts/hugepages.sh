@@ -1,7 +1,8 @@
 #!/bin/bash
 
-# The amount of memory we want to be available for hugepages (in MB).
-hugepage_mb=1024
+# The amount of memory we want to be available for hugepages (in MB), which
+# lets the measuring thread and one interfering thread each map 1 GB.
+hugepage_mb=2048
 
 # The platform specific hugepage size (in KB).
 hugepage_size_kb=$(grep Hugepagesize /proc/meminfo | awk {'print $2'})
@@ -14,3 +15,13 @@ echo "Reserving $hugepage_mb MB for hugepages, which is $nr_hugepages hugepages.
 sysctl -w vm.nr_hugepages=$nr_hugepages
 
 hugeadm --pool-pages-min 2MB:$nr_hugepages
+
+# Reserve two 1 GB pages, if supported, for the -1gb benchmarks, one for the
+# measuring thread and one for an interfering thread. This can fail once
+# memory is fragmented, in which case reserve them at boot time with
+# "hugepagesz=1G hugepages=2" on the kernel command line.
+gigantic=/sys/kernel/mm/hugepages/hugepages-1048576kB/nr_hugepages
+if [ -f $gigantic ]; then
+  echo "Reserving two 1 GB hugepages."
+  echo 2 > $gigantic
+fi
@@ -16,6 +16,12 @@ df = pd.read_csv(args.filename, delimiter=',', header=0)
 df = df.loc[df['percentile'] != 'mean']
 df = df.loc[df['percentile'] != 'stddev']
 df = df.loc[df['percentile'] != 'samples']
+df = df.loc[df['percentile'] != 'overhead']
+df = df.loc[df['percentile'] != 'batch']
+df = df.loc[df['percentile'] != 'rate']
+df = df.loc[df['percentile'] != 'throughput']
+df = df.loc[df['percentile'] != 'ns_per_byte']
+df = df.loc[df['percentile'] != 'tasks_per_sec']
 df['percentile'] = df['percentile'].astype(float)
 df = df.loc[df['percentile'] <= 99]
 df['time'] = df['time'] / 1000
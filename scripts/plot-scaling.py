@@ -0,0 +1,34 @@
+#!/usr/bin/env python3
+
+import matplotlib.pyplot as plt
+import matplotlib as mpl
+
+import pandas as pd
+import argparse
+import os
+
+parser = argparse.ArgumentParser(description='Generate some plots.')
+parser.add_argument("filename", help='The name of a data file to generate a plot from.')
+args = parser.parse_args()
+
+df = pd.read_csv(args.filename, delimiter=',', header=0)
+
+plt.style.use('seaborn-ticks')
+
+fig, (ax1, ax2) = plt.subplots(2, 1, sharex=True)
+
+ax1.plot(df['threads'], df['ops_per_sec'] / 1e6, marker='o')
+ax1.set_ylabel('Throughput (Mops/s)')
+
+for percentile in ['p50', 'p99', 'p99.9']:
+  ax2.plot(df['threads'], df[percentile] / 1000, marker='o', label=percentile)
+ax2.set_yscale('log')
+ax2.set_ylabel('Time (μs)')
+ax2.legend(loc='upper left', frameon=True, framealpha=1)
+
+prefix, _ = os.path.splitext(args.filename)
+
+plt.xlabel(f"Threads ({prefix})")
+
+plt.savefig("%s.pdf" % (prefix), format='pdf')
+plt.savefig("%s.png" % (prefix), format='png')
@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+
+import matplotlib.pyplot as plt
+import matplotlib as mpl
+
+import pandas as pd
+import argparse
+import glob
+import os
+import re
+
+parser = argparse.ArgumentParser(description='Plot latency against the size of the operation.')
+parser.add_argument("directory", help='The latency output directory of a size sweep.')
+parser.add_argument("prefix", help='The benchmark name without the size suffix (e.g. bench-mmap-4kb).')
+args = parser.parse_args()
+
+units = {'kb': 1024, 'mb': 1024 ** 2, 'gb': 1024 ** 3}
+pattern = re.compile(re.escape(args.prefix) + r'-(\d+)(kb|mb|gb)\.csv$')
+
+rows = []
+for filename in glob.glob(os.path.join(args.directory, args.prefix + '-*.csv')):
+  match = pattern.search(os.path.basename(filename))
+  if not match:
+    continue
+  size = int(match.group(1)) * units[match.group(2)]
+  df = pd.read_csv(filename, delimiter=',', header=0)
+  for scenario, group in df.groupby('scenario', sort=False):
+    values = dict(zip(group['percentile'].astype(str), group['time']))
+    rows.append({
+      'size': size,
+      'scenario': scenario,
+      'mean': float(values['mean']),
+      'p50': float(values['50']),
+      'p99': float(values['99']),
+      'p99.9': float(values['99.9']),
+    })
+
+if not rows:
+  parser.error(f"no size sweep results for {args.prefix} in {args.directory}")
+
+df = pd.DataFrame(rows).sort_values(['scenario', 'size'])
+
+prefix = os.path.join(args.directory, args.prefix + '-size')
+df.to_csv("%s.csv" % (prefix), index=False)
+
+plt.style.use('seaborn-ticks')
+
+fig, ax = plt.subplots()
+for scenario, group in df.groupby('scenario', sort=False):
+  for percentile in ['p50', 'p99']:
+    ax.plot(group['size'] / 1024, group[percentile] / 1000, marker='o', label=f"{scenario} {percentile}")
+ax.set_xscale('log', base=2)
+ax.set_yscale('log')
+
+plt.xlabel(f"Size (KB) ({args.prefix})")
+plt.ylabel('Time (μs)')
+plt.legend(loc='upper left', frameon=True, framealpha=1)
+
+plt.savefig("%s.pdf" % (prefix), format='pdf')
+plt.savefig("%s.png" % (prefix), format='png')